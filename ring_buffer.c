@@ -5,6 +5,38 @@
 #include <stdio.h>
 #include "ring_buffer.h"
 
+// Power of two sized buffers (mask != 0) use free running head / tail with
+// bitmask wraparound: no division (which is a library call on Cortex-M0)
+// and no "used" counter - it is simply head - tail.
+// Any other size keeps head / tail within buffer and maintains "used".
+static inline uint32_t ring_buffer_offset(struct ring_buffer* meta, uint32_t index)
+{
+  if (meta->mask) {
+    return index & meta->mask;
+  }
+  return index;
+}
+
+static inline void ring_buffer_produced(struct ring_buffer* meta, uint32_t len)
+{
+  if (meta->mask) {
+    meta->head += len;
+  } else {
+    meta->head = (meta->head + len) % meta->size;
+    meta->used += len;
+  }
+}
+
+static inline void ring_buffer_consumed(struct ring_buffer* meta, uint32_t len)
+{
+  if (meta->mask) {
+    meta->tail += len;
+  } else {
+    meta->tail = (meta->tail + len) % meta->size;
+    meta->used -= len;
+  }
+}
+
 
 void ring_buffer_init(struct ring_buffer* meta, uint8_t* buf, uint32_t buf_size)
 {
@@ -12,34 +44,78 @@ void ring_buffer_init(struct ring_buffer* meta, uint8_t* buf, uint32_t buf_size)
   meta->head = 0;
   meta->tail = 0;
   meta->used = 0;
+  meta->dropped = 0;
   meta->size = buf_size;
+  // Select masked mode for power of two sizes
+  if (buf_size > 1 && (buf_size & (buf_size - 1)) == 0) {
+    meta->mask = buf_size - 1;
+  } else {
+    meta->mask = 0;
+  }
 }
 
-bool ring_buffer_write(struct ring_buffer* meta, uint8_t* buf, uint32_t write_size)
+// Buffer offset of "index" + "len" (len <= size)
+static inline uint32_t ring_buffer_offset_add(struct ring_buffer* meta, uint32_t index, uint32_t len)
 {
-  if (write_size == 0) {
-    return true;
+  if (meta->mask) {
+    return (index + len) & meta->mask;
   }
-  if (write_size > ring_buffer_free(meta)) {
-    // Not enough free space in the buffer
-    return false;
+  index += len;
+  if (index >= meta->size) {
+    index -= meta->size;
   }
+  return index;
+}
 
-  uint32_t remainder = meta->size - meta->head;
-  if (write_size <= remainder) {
+// Copies data into ring memory starting from buffer offset "pos".
+// Does not update head.
+static void ring_buffer_copy_in(struct ring_buffer* meta, uint32_t pos, const uint8_t* buf, uint32_t len)
+{
+  uint32_t remainder = meta->size - pos;
+  if (len <= remainder) {
     // Buffer is not rolled over, copy everything
-    memcpy(&meta->buf[meta->head], buf, write_size);
+    memcpy(&meta->buf[pos], buf, len);
   } else {
     // Rolled over buffer, 2 step data copy
     // Data fragment till the buffer end
-    memcpy(&meta->buf[meta->head], buf, remainder);
+    memcpy(&meta->buf[pos], buf, remainder);
     buf += remainder;
     // Second fragment is from beginning
-    memcpy(meta->buf, buf, write_size - remainder);
+    memcpy(meta->buf, buf, len - remainder);
+  }
+}
+
+// Copies data from ring memory starting from buffer offset "pos".
+// Does not update tail.
+static void ring_buffer_copy_out(struct ring_buffer* meta, uint32_t pos, uint8_t* buf, uint32_t len)
+{
+  uint32_t tail_data_len = meta->size - pos;
+
+  // If requested data length does not rollover buffer so can be
+  // done in single copy
+  if (len <= tail_data_len) {
+    memcpy(buf, &meta->buf[pos], len);
+  } else {
+    // Copy data in 2 steps: remainder and the rest from the beginning
+    memcpy(buf, &meta->buf[pos], tail_data_len);
+    buf += tail_data_len;
+    memcpy(buf, meta->buf, len - tail_data_len);
+  }
+}
+
+bool ring_buffer_write(struct ring_buffer* meta, const uint8_t* buf, uint32_t write_size)
+{
+  if (write_size == 0) {
+    return true;
+  }
+  if (write_size > ring_buffer_free(meta)) {
+    // Not enough free space in the buffer
+    return false;
   }
+
+  ring_buffer_copy_in(meta, ring_buffer_offset(meta, meta->head), buf, write_size);
   // Update head/size: we've written some data
-  meta->head = (meta->head + write_size) % meta->size;
-  meta->used += write_size;
+  ring_buffer_produced(meta, write_size);
 
   return true;
 }
@@ -49,45 +125,230 @@ bool ring_buffer_read(struct ring_buffer* meta, uint8_t* buf, uint32_t read_size
   if (read_size == 0) {
     return true;
   }
-  if (read_size > meta->used) {
+  if (read_size > ring_buffer_used(meta)) {
     // Not enough data in the buffer
     return false;
   }
 
-  uint32_t tail_data_len = meta->size - meta->tail;
-
-  // If requested data length does not rollover buffer so can be
-  // done in single copy
-  if (read_size <= tail_data_len) {
-    memcpy(buf, &meta->buf[meta->tail], read_size);
-  } else {
-    // Copy data in 2 steps: remainder and the rest from the beginning
-    memcpy(buf, &meta->buf[meta->tail], tail_data_len);
-    buf += tail_data_len;
-    memcpy(buf, meta->buf, read_size - tail_data_len);
-  }
-
+  ring_buffer_copy_out(meta, ring_buffer_offset(meta, meta->tail), buf, read_size);
   // Update tail/used: we've read some data
-  meta->tail = (meta->tail + read_size) % meta->size;
-  meta->used -= read_size;
+  ring_buffer_consumed(meta, read_size);
 
   return true;
 }
 
 uint32_t ring_buffer_used(struct ring_buffer* meta)
 {
+  if (meta->mask) {
+    return meta->head - meta->tail;
+  }
   return meta->used;
 }
 
 uint32_t ring_buffer_free(struct ring_buffer* meta)
 {
-  return meta->size - meta->used;
+  return meta->size - ring_buffer_used(meta);
+}
+
+// Describes "len" bytes of ring memory starting from "index" (head / tail)
+static void ring_buffer_make_spans(struct ring_buffer* meta, uint32_t index, uint32_t len,
+                                   struct ring_buffer_span spans[2])
+{
+  uint32_t start = ring_buffer_offset(meta, index);
+  uint32_t remainder = meta->size - start;
+
+  spans[0].buf = &meta->buf[start];
+  if (len <= remainder) {
+    spans[0].len = len;
+    spans[1].buf = meta->buf;
+    spans[1].len = 0;
+  } else {
+    // Region is rolled over
+    spans[0].len = remainder;
+    spans[1].buf = meta->buf;
+    spans[1].len = len - remainder;
+  }
+}
+
+uint32_t ring_buffer_write_reserve(struct ring_buffer* meta, uint32_t size, struct ring_buffer_span spans[2])
+{
+  uint32_t free = ring_buffer_free(meta);
+
+  if (size > free) {
+    size = free;
+  }
+  ring_buffer_make_spans(meta, meta->head, size, spans);
+
+  return size;
+}
+
+bool ring_buffer_write_commit(struct ring_buffer* meta, uint32_t size)
+{
+  if (size > ring_buffer_free(meta)) {
+    return false;
+  }
+  ring_buffer_produced(meta, size);
+
+  return true;
+}
+
+uint32_t ring_buffer_read_peek(struct ring_buffer* meta, uint32_t size, struct ring_buffer_span spans[2])
+{
+  uint32_t used = ring_buffer_used(meta);
+
+  if (size > used) {
+    size = used;
+  }
+  ring_buffer_make_spans(meta, meta->tail, size, spans);
+
+  return size;
+}
+
+bool ring_buffer_read_consume(struct ring_buffer* meta, uint32_t size)
+{
+  if (size > ring_buffer_used(meta)) {
+    return false;
+  }
+  ring_buffer_consumed(meta, size);
+
+  return true;
+}
+
+// Records: varint (LEB128, same as protobuf length prefix) encoded length
+// followed by payload.
+#define RING_BUFFER_VARINT_MAX_LEN   5
+
+static uint32_t ring_buffer_varint_encode(uint32_t value, uint8_t* buf)
+{
+  uint32_t len = 0;
+
+  while (value >= 0x80) {
+    buf[len++] = (uint8_t)(value | 0x80);
+    value >>= 7;
+  }
+  buf[len++] = (uint8_t)value;
+
+  return len;
+}
+
+// Decodes record header (payload length) located at tail without consuming it.
+// Returns header length or 0 when there is no (complete) record.
+static uint32_t ring_buffer_record_header(struct ring_buffer* meta, uint32_t* size)
+{
+  uint8_t  header[RING_BUFFER_VARINT_MAX_LEN];
+  uint32_t used = ring_buffer_used(meta);
+  uint32_t len = used < sizeof(header) ? used : sizeof(header);
+  uint32_t value = 0;
+
+  ring_buffer_copy_out(meta, ring_buffer_offset(meta, meta->tail), header, len);
+  for (uint32_t i = 0; i < len; i++) {
+    value |= (uint32_t)(header[i] & 0x7f) << (7 * i);
+    if ((header[i] & 0x80) == 0) {
+      if (value > used - i - 1) {
+        // Payload is not complete
+        return 0;
+      }
+      *size = value;
+      return i + 1;
+    }
+  }
+
+  return 0;
+}
+
+bool ring_buffer_write_record(struct ring_buffer* meta, const uint8_t* buf, uint32_t size)
+{
+  uint8_t  header[RING_BUFFER_VARINT_MAX_LEN];
+  uint32_t header_len = ring_buffer_varint_encode(size, header);
+
+  if (size > ring_buffer_free(meta) || header_len + size > ring_buffer_free(meta)) {
+    // Record does not fit, nothing written
+    return false;
+  }
+
+  uint32_t pos = ring_buffer_offset(meta, meta->head);
+  ring_buffer_copy_in(meta, pos, header, header_len);
+  ring_buffer_copy_in(meta, ring_buffer_offset_add(meta, pos, header_len), buf, size);
+  // Publish whole record at once
+  ring_buffer_produced(meta, header_len + size);
+
+  return true;
+}
+
+bool ring_buffer_next_record_size(struct ring_buffer* meta, uint32_t* size)
+{
+  return ring_buffer_record_header(meta, size) != 0;
+}
+
+bool ring_buffer_read_record(struct ring_buffer* meta, uint8_t* buf, uint32_t buf_size, uint32_t* size)
+{
+  uint32_t record_size;
+  uint32_t header_len = ring_buffer_record_header(meta, &record_size);
+
+  if (header_len == 0 || record_size > buf_size) {
+    // No record or it does not fit into buffer: record stays in ring
+    return false;
+  }
+
+  uint32_t pos = ring_buffer_offset_add(meta, ring_buffer_offset(meta, meta->tail), header_len);
+  ring_buffer_copy_out(meta, pos, buf, record_size);
+  ring_buffer_consumed(meta, header_len + record_size);
+  *size = record_size;
+
+  return true;
+}
+
+void ring_buffer_write_overwrite(struct ring_buffer* meta, const uint8_t* buf, uint32_t write_size)
+{
+  if (write_size > meta->size) {
+    // Only the last "size" bytes survive anyway
+    uint32_t skip = write_size - meta->size;
+    meta->dropped += skip;
+    buf += skip;
+    write_size = meta->size;
+  }
+
+  uint32_t free = ring_buffer_free(meta);
+  if (write_size > free) {
+    ring_buffer_consumed(meta, write_size - free);
+    meta->dropped += write_size - free;
+  }
+
+  ring_buffer_copy_in(meta, ring_buffer_offset(meta, meta->head), buf, write_size);
+  ring_buffer_produced(meta, write_size);
+}
+
+bool ring_buffer_write_record_overwrite(struct ring_buffer* meta, const uint8_t* buf, uint32_t size)
+{
+  uint8_t  header[RING_BUFFER_VARINT_MAX_LEN];
+  uint32_t header_len = ring_buffer_varint_encode(size, header);
+
+  if (size > meta->size || header_len + size > meta->size) {
+    // Record will never fit
+    return false;
+  }
+
+  // Drop the oldest records until there is enough space
+  while (header_len + size > ring_buffer_free(meta)) {
+    uint32_t record_size;
+    uint32_t record_header_len = ring_buffer_record_header(meta, &record_size);
+    uint32_t len;
+    if (record_header_len == 0) {
+      // Not a record: drop everything
+      len = ring_buffer_used(meta);
+    } else {
+      len = record_header_len + record_size;
+    }
+    ring_buffer_consumed(meta, len);
+    meta->dropped += len;
+  }
+
+  return ring_buffer_write_record(meta, buf, size);
 }
 
 void ring_buffer_advance_head(struct ring_buffer* meta, uint32_t how_many)
 {
-  meta->used += how_many;
-  meta->head = (meta->head + how_many) % meta->size;
+  ring_buffer_produced(meta, how_many);
 }
 
 void ring_buffer_reset(struct ring_buffer* meta)
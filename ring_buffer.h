@@ -13,19 +13,60 @@
 #define EXPORT
 #endif
 
+// When buffer size is power of two ring_buffer_init() selects masked mode:
+// head / tail are free running and wrapped with bitmask, "used" is not
+// maintained (use ring_buffer_used()). Division free, so it is the preferred
+// choice for Cortex-M0/M0+ which lack hardware divider.
 struct ring_buffer {
   uint8_t* buf;
   uint32_t tail;
   uint32_t head;
   uint32_t size;
   uint32_t used;
+  uint32_t mask;
+  uint32_t dropped;
+};
+
+// Contiguous chunk of ring buffer memory
+struct ring_buffer_span {
+  uint8_t* buf;
+  uint32_t len;
 };
 
 EXPORT void     ring_buffer_init(struct ring_buffer* meta, uint8_t* buf, uint32_t buf_size);
 
-EXPORT bool     ring_buffer_write(struct ring_buffer* meta, uint8_t* buf, uint32_t write_size);
+EXPORT bool     ring_buffer_write(struct ring_buffer* meta, const uint8_t* buf, uint32_t write_size);
 EXPORT bool     ring_buffer_read(struct ring_buffer* meta, uint8_t* buf, uint32_t read_size);
 
+// Zero copy API: instead of copying data in/out of ring it gives direct access
+// to ring memory (e.g. for DMA, HAL_UART_Transmit_DMA, parsers).
+// Region may wrap around end of the buffer, so it is described by 2 spans
+// (second one has zero length when region is contiguous).
+// Reserve / peek return total length of spans which may be less than requested.
+EXPORT uint32_t ring_buffer_write_reserve(struct ring_buffer* meta, uint32_t size, struct ring_buffer_span spans[2]);
+EXPORT bool     ring_buffer_write_commit(struct ring_buffer* meta, uint32_t size);
+EXPORT uint32_t ring_buffer_read_peek(struct ring_buffer* meta, uint32_t size, struct ring_buffer_span spans[2]);
+EXPORT bool     ring_buffer_read_consume(struct ring_buffer* meta, uint32_t size);
+
+// Records: length prefixed (varint) messages.
+// Record is written completely or not written at all, so reader never sees
+// partial record. Reader gets whole record in one call; if destination buffer
+// is too small read fails and record remains in ring.
+EXPORT bool     ring_buffer_write_record(struct ring_buffer* meta, const uint8_t* buf, uint32_t size);
+EXPORT bool     ring_buffer_next_record_size(struct ring_buffer* meta, uint32_t* size);
+EXPORT bool     ring_buffer_read_record(struct ring_buffer* meta, uint8_t* buf, uint32_t buf_size, uint32_t* size);
+
+// Overwrite oldest (lossy) writes: never fail because of lack of space,
+// instead the oldest data is dropped (tail advanced) and "dropped" counter is
+// incremented by number of bytes lost.
+// Byte version drops bytes, record version drops whole records (so it must
+// be used only on rings containing records).
+// Record version fails only when record is larger than whole ring.
+// NOTE: producer moves tail, so these are not suitable for concurrent
+// producer / consumer without locking.
+EXPORT void     ring_buffer_write_overwrite(struct ring_buffer* meta, const uint8_t* buf, uint32_t write_size);
+EXPORT bool     ring_buffer_write_record_overwrite(struct ring_buffer* meta, const uint8_t* buf, uint32_t size);
+
 EXPORT void     ring_buffer_advance_head(struct ring_buffer* meta, uint32_t how_many);
 EXPORT void     ring_buffer_reset(struct ring_buffer* meta);
 EXPORT uint32_t ring_buffer_used(struct ring_buffer* meta);
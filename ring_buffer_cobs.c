@@ -0,0 +1,177 @@
+// Copyright (c) Konstantin Belyalov. All rights reserved.
+// Licensed under the MIT license.
+
+#include "ring_buffer_cobs.h"
+
+// Stores byte at "pos" of reserved (not committed) ring area
+static inline void ring_buffer_cobs_put(struct ring_buffer_span spans[2], uint32_t pos, uint8_t byte)
+{
+  if (pos < spans[0].len) {
+    spans[0].buf[pos] = byte;
+  } else {
+    spans[1].buf[pos - spans[0].len] = byte;
+  }
+}
+
+struct ring_buffer_cobs_encoder {
+  struct ring_buffer_span spans[2];
+  uint32_t code_pos;    // Position of current block code byte, backfilled
+  uint32_t pos;
+  uint8_t  code;
+};
+
+static void ring_buffer_cobs_encode_chunk(struct ring_buffer_cobs_encoder* enc, const uint8_t* buf, uint32_t size)
+{
+  for (uint32_t i = 0; i < size; i++) {
+    if (enc->code == 0xFF) {
+      // Block of 254 non zero bytes is closed only when more data follows,
+      // so frame ending exactly at block boundary has no extra empty block
+      ring_buffer_cobs_put(enc->spans, enc->code_pos, enc->code);
+      enc->code_pos = enc->pos++;
+      enc->code = 1;
+    }
+    if (buf[i] == 0) {
+      ring_buffer_cobs_put(enc->spans, enc->code_pos, enc->code);
+      enc->code_pos = enc->pos++;
+      enc->code = 1;
+    } else {
+      ring_buffer_cobs_put(enc->spans, enc->pos++, buf[i]);
+      enc->code++;
+    }
+  }
+}
+
+// Reserves space for worst case frame, returns false if it does not fit
+static bool ring_buffer_cobs_encode_begin(struct ring_buffer_cobs_encoder* enc, struct ring_buffer* out, uint32_t size)
+{
+  uint32_t max = RING_BUFFER_COBS_MAX_ENCODED_SIZE(size);
+
+  if (ring_buffer_write_reserve(out, max, enc->spans) != max) {
+    return false;
+  }
+  enc->code_pos = 0;
+  enc->pos = 1;
+  enc->code = 1;
+
+  return true;
+}
+
+// Closes the last block, adds delimiter and publishes frame
+static bool ring_buffer_cobs_encode_end(struct ring_buffer_cobs_encoder* enc, struct ring_buffer* out)
+{
+  ring_buffer_cobs_put(enc->spans, enc->code_pos, enc->code);
+  ring_buffer_cobs_put(enc->spans, enc->pos++, 0);
+
+  return ring_buffer_write_commit(out, enc->pos);
+}
+
+bool ring_buffer_cobs_encode(struct ring_buffer* out, const uint8_t* buf, uint32_t size)
+{
+  struct ring_buffer_cobs_encoder enc;
+
+  if (!ring_buffer_cobs_encode_begin(&enc, out, size)) {
+    return false;
+  }
+  ring_buffer_cobs_encode_chunk(&enc, buf, size);
+
+  return ring_buffer_cobs_encode_end(&enc, out);
+}
+
+bool ring_buffer_cobs_encode_ring(struct ring_buffer* out, struct ring_buffer* in, uint32_t size)
+{
+  struct ring_buffer_cobs_encoder enc;
+  struct ring_buffer_span src[2];
+
+  if (ring_buffer_read_peek(in, size, src) != size) {
+    // Not enough data
+    return false;
+  }
+  if (!ring_buffer_cobs_encode_begin(&enc, out, size)) {
+    return false;
+  }
+  ring_buffer_cobs_encode_chunk(&enc, src[0].buf, src[0].len);
+  ring_buffer_cobs_encode_chunk(&enc, src[1].buf, src[1].len);
+  ring_buffer_read_consume(in, size);
+
+  return ring_buffer_cobs_encode_end(&enc, out);
+}
+
+static void ring_buffer_cobs_decoder_reset(struct ring_buffer_cobs_decoder* dec)
+{
+  dec->len = 0;
+  dec->code = 0;
+  dec->left = 0;
+  dec->error = false;
+}
+
+void ring_buffer_cobs_decoder_init(struct ring_buffer_cobs_decoder* dec, struct ring_buffer* out)
+{
+  dec->out = out;
+  dec->dropped = 0;
+  ring_buffer_cobs_decoder_reset(dec);
+}
+
+bool ring_buffer_cobs_decode(struct ring_buffer_cobs_decoder* dec, struct ring_buffer* in, uint32_t* frame_len)
+{
+  struct ring_buffer_span src[2];
+  struct ring_buffer_span dst[2];
+  uint32_t consumed = 0;
+
+  ring_buffer_read_peek(in, ring_buffer_used(in), src);
+  // Pending bytes of current frame live in reserved area of output ring,
+  // so they are simply re-reserved (head does not move between calls)
+  uint32_t room = ring_buffer_write_reserve(dec->out, ring_buffer_free(dec->out), dst);
+
+  for (uint32_t s = 0; s < 2; s++) {
+    for (uint32_t i = 0; i < src[s].len; i++) {
+      uint8_t byte = src[s].buf[i];
+      consumed++;
+
+      if (byte == 0) {
+        // Frame delimiter
+        bool complete = !dec->error && dec->code != 0 && dec->left == 0;
+        uint32_t len = dec->len;
+        if (!complete && (dec->error || dec->code != 0)) {
+          // Broken / truncated frame. Empty one (two delimiters in a row) is fine.
+          dec->dropped++;
+        }
+        ring_buffer_cobs_decoder_reset(dec);
+        if (complete) {
+          ring_buffer_write_commit(dec->out, len);
+          ring_buffer_read_consume(in, consumed);
+          *frame_len = len;
+          return true;
+        }
+        continue;
+      }
+      if (dec->error) {
+        continue;
+      }
+
+      if (dec->left == 0) {
+        // Block code byte. Every block except of 254 data bytes long one is
+        // followed by zero (the last one is terminated by delimiter instead)
+        if (dec->code != 0 && dec->code != 0xFF) {
+          if (dec->len >= room) {
+            dec->error = true;
+            continue;
+          }
+          ring_buffer_cobs_put(dst, dec->len++, 0);
+        }
+        dec->code = byte;
+        dec->left = byte - 1;
+      } else {
+        if (dec->len >= room) {
+          // Frame does not fit into output ring
+          dec->error = true;
+          continue;
+        }
+        ring_buffer_cobs_put(dst, dec->len++, byte);
+        dec->left--;
+      }
+    }
+  }
+  ring_buffer_read_consume(in, consumed);
+
+  return false;
+}
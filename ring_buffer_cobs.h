@@ -0,0 +1,61 @@
+// Copyright (c) Konstantin Belyalov. All rights reserved.
+// Licensed under the MIT license.
+
+#ifndef __RING_BUFFER_COBS_H
+#define __RING_BUFFER_COBS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "ring_buffer.h"
+
+#ifdef __cplusplus
+#define EXPORT extern "C"
+#else
+#define EXPORT
+#endif
+
+// Streaming COBS (Consistent Overhead Byte Stuffing) framing on top of
+// struct ring_buffer. Encoded frame contains no zero bytes and is terminated
+// by 0x00 delimiter, so receiver re-synchronizes on the next delimiter after
+// line noise / lost bytes.
+// Both directions work in O(n) directly on ring memory, without intermediate
+// frame buffer.
+
+// Maximum encoded frame size (including delimiter) for "size" bytes of payload
+#define RING_BUFFER_COBS_MAX_ENCODED_SIZE(size) ((size) + (size) / 254 + 2)
+
+// Encodes "size" bytes as single frame into "out" ring.
+// Frame is either written completely or not at all (returns false when
+// there is no space for worst case frame size).
+EXPORT bool ring_buffer_cobs_encode(struct ring_buffer* out, const uint8_t* buf, uint32_t size);
+// Same as above, but payload is "size" bytes consumed from "in" ring
+// (e.g. message encoded by pb_encode_to_ring_buffer())
+EXPORT bool ring_buffer_cobs_encode_ring(struct ring_buffer* out, struct ring_buffer* in, uint32_t size);
+
+// Incremental decoder. Decoded bytes are written straight into reserved
+// (not yet committed) area of "out" ring and published as single frame once
+// delimiter is received. Decoder must be the only writer of "out".
+// Broken frames (bad encoding / does not fit into "out") are dropped.
+//
+// Usage (e.g. with ring_buffer_dma on receive side):
+//   uint32_t len;
+//   while (ring_buffer_cobs_decode(&dec, &rx.ring, &len)) {
+//     pb_decode_from_ring_buffer(&frames, len, fields, &msg);
+//   }
+struct ring_buffer_cobs_decoder {
+  struct ring_buffer* out;
+  uint32_t len;       // Decoded (pending) bytes of current frame
+  uint8_t  code;      // Code of current block, 0 at frame start
+  uint8_t  left;      // Data bytes left in current block
+  bool     error;     // Current frame is broken: skip till delimiter
+  uint32_t dropped;   // Broken frames counter
+};
+
+EXPORT void ring_buffer_cobs_decoder_init(struct ring_buffer_cobs_decoder* dec, struct ring_buffer* out);
+// Consumes bytes from "in" up to (including) next frame delimiter.
+// Returns true when frame is complete: it is committed into "out" ring and
+// its length stored into "frame_len". Otherwise all input is consumed,
+// partially decoded frame is kept pending.
+EXPORT bool ring_buffer_cobs_decode(struct ring_buffer_cobs_decoder* dec, struct ring_buffer* in, uint32_t* frame_len);
+
+#endif
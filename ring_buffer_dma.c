@@ -0,0 +1,44 @@
+// Copyright (c) Konstantin Belyalov. All rights reserved.
+// Licensed under the MIT license.
+
+#include "ring_buffer_dma.h"
+
+
+void ring_buffer_dma_init(struct ring_buffer_dma* meta, DMA_HandleTypeDef* hdma, uint8_t* buf, uint32_t buf_size)
+{
+  ring_buffer_init(&meta->ring, buf, buf_size);
+  meta->hdma = hdma;
+  meta->dma_pos = 0;
+}
+
+void ring_buffer_dma_update(struct ring_buffer_dma* meta)
+{
+  uint32_t size = meta->ring.size;
+  // DMA counter counts down from buffer size, reloads on wraparound
+  uint32_t pos = size - __HAL_DMA_GET_COUNTER(meta->hdma);
+  if (pos >= size) {
+    pos = 0;
+  }
+
+  // How many bytes DMA has written since last update
+  uint32_t received;
+  if (pos >= meta->dma_pos) {
+    received = pos - meta->dma_pos;
+  } else {
+    received = size - meta->dma_pos + pos;
+  }
+  if (received == 0) {
+    return;
+  }
+  meta->dma_pos = pos;
+
+  // Consumer was too slow: DMA has already overwritten oldest data
+  uint32_t free = ring_buffer_free(&meta->ring);
+  if (received > free) {
+    uint32_t lost = received - free;
+    ring_buffer_read_consume(&meta->ring, lost);
+    meta->ring.dropped += lost;
+  }
+
+  ring_buffer_advance_head(&meta->ring, received);
+}
@@ -0,0 +1,50 @@
+// Copyright (c) Konstantin Belyalov. All rights reserved.
+// Licensed under the MIT license.
+
+#ifndef __RING_BUFFER_DMA_H
+#define __RING_BUFFER_DMA_H
+
+#include "main.h"
+#include "ring_buffer.h"
+
+#ifdef __cplusplus
+#define EXPORT extern "C"
+#else
+#define EXPORT
+#endif
+
+// Circular DMA receive adapter: ring buffer memory *is* circular DMA buffer,
+// so received data is not copied from DMA buffer into ring.
+// Ring head is derived from DMA counter (NDTR) whenever
+// ring_buffer_dma_update() is called, consumers use regular ring_buffer_read()
+// (or peek / consume) on "ring" member.
+//
+// Usage:
+//   ring_buffer_dma_init(&rx, huart.hdmarx, buf, sizeof(buf));
+//   HAL_UART_Receive_DMA(&huart, buf, sizeof(buf));   // DMA in circular mode
+//   // then call ring_buffer_dma_update(&rx) from:
+//   //  - HAL_UART_RxHalfCpltCallback()
+//   //  - HAL_UART_RxCpltCallback()
+//   //  - HAL_UARTEx_RxEventCallback() / idle line interrupt
+//
+// Notes:
+//  - update must be called at least once per half of buffer (half / complete
+//    events guarantee that), otherwise full buffer turnaround is not detectable.
+//  - use power of two buffer size: then update changes only ring head as long
+//    as there is no overrun, so it is safe to call it from ISR while task
+//    consumes data.
+//  - if consumer is too slow DMA overwrites unread data: oldest data is dropped
+//    (tail moved forward) and ring "dropped" counter incremented by number of
+//    bytes lost. Overrun handling is NOT safe against concurrent consumer:
+//    tail moved by ISR races with task's read / consume. Size buffer so that
+//    overrun never happens, or consume with DMA interrupts disabled.
+struct ring_buffer_dma {
+  struct ring_buffer  ring;
+  DMA_HandleTypeDef*  hdma;
+  uint32_t            dma_pos;
+};
+
+EXPORT void ring_buffer_dma_init(struct ring_buffer_dma* meta, DMA_HandleTypeDef* hdma, uint8_t* buf, uint32_t buf_size);
+EXPORT void ring_buffer_dma_update(struct ring_buffer_dma* meta);
+
+#endif
@@ -1,8 +1,11 @@
 // Copyright (c) Konstantin Belyalov. All rights reserved.
 // Licensed under the MIT license.
 
-#ifndef __RING_BUFFER_H
-#define __RING_BUFFER_H
+#ifndef __RING_BUFFER_FIXED_SIZE_H
+#define __RING_BUFFER_FIXED_SIZE_H
+
+#include <stddef.h>
+#include <string.h>
 
 // Declares ring buffer structure
 #define RING_BUFFER_DECLARE(_name, _item, _size)      \
@@ -11,7 +14,7 @@
         size_t head;                                  \
         size_t tail;                                  \
         size_t size;                                  \
-        uint8_t full;                                 \
+        size_t dropped;                               \
     };                                                \
 // Defines and initializes ring buffer structure.
 // Params:
@@ -19,46 +22,132 @@
 //  - _item: ring buffer item type
 //  - _size: ring size (items count)
 #define RING_BUFFER_DEFINE(_name, _item, _size)              \
-    struct _name##_ring _name##_ring_def = {{0}, 0, 0, _size}; \
+    struct _name##_ring _name##_ring_def = {{0}, 0, 0, _size, 0}; \
     struct _name##_ring *_name = &_name##_ring_def;
 
+// Ring capacity, compile time constant.
+#define RING_BUFFER_CAPACITY(_name) (sizeof((_name)->buffer) / sizeof((_name)->buffer[0]))
+
+// Index helpers (internal).
+// Since capacity is known at compile time all branches below are folded by
+// compiler, so there is no runtime mode check:
+//  - power of two capacity: head / tail are free running, wrapped by bitmask
+//  - any other capacity: head / tail run in [0, 2 * capacity) range, so
+//    full / empty buffers are distinguishable and no division is needed
+#define _RING_BUFFER_POW2(_name) ((RING_BUFFER_CAPACITY(_name) & (RING_BUFFER_CAPACITY(_name) - 1)) == 0)
+
+#define _RING_BUFFER_OFFSET(_name, _index)                                        \
+    (_RING_BUFFER_POW2(_name) ? ((_index) & (RING_BUFFER_CAPACITY(_name) - 1)) :  \
+     ((_index) >= RING_BUFFER_CAPACITY(_name) ? (_index) - RING_BUFFER_CAPACITY(_name) : (_index)))
+
+// Advances index by _n items (_n <= capacity)
+#define _RING_BUFFER_ADVANCE(_name, _index, _n)                                   \
+    (_RING_BUFFER_POW2(_name) ? ((_index) + (_n)) :                               \
+     ((_index) + (_n) >= 2 * RING_BUFFER_CAPACITY(_name) ?                        \
+      (_index) + (_n) - 2 * RING_BUFFER_CAPACITY(_name) : (_index) + (_n)))
+
+#define _RING_BUFFER_NEXT(_name, _index) _RING_BUFFER_ADVANCE(_name, _index, 1)
+
+#define _RING_BUFFER_USED(_name)                                                  \
+    (_RING_BUFFER_POW2(_name) || (_name)->head >= (_name)->tail ?                 \
+     (_name)->head - (_name)->tail :                                              \
+     (_name)->head + 2 * RING_BUFFER_CAPACITY(_name) - (_name)->tail)
+
+// Push policy is overwrite oldest: push never fails, when buffer is full
+// the oldest item gets overwritten and "dropped" counter is incremented.
+
 // Pushes "_item" into ring buffer (does memcpy)
 #define RING_BUFFER_PUSH_COPY(_name, _item)                                 \
     ({                                                                      \
-        (_name)->head = ((_name)->head + 1) % (_name)->size;                \
-        memcpy(&(_name)->buffer[(_name)->head], _item, sizeof(*_item));     \
-        if (!(_name)->full) (_name)->full = (_name)->head == (_name)->tail; \
+        memcpy(RING_BUFFER_PUSH(_name), _item, sizeof(*_item));             \
     })
 
 // "Pushes" item (basically does pointer advance) and returns it.
 // You must copy data yourself
 #define RING_BUFFER_PUSH(_name)                                               \
     ({                                                                        \
-        (_name)->head = ((_name)->head + 1) % (_name)->size;                  \
-        if (!(_name)->full) (_name)->full = ((_name)->head == (_name)->tail); \
-        &(_name)->buffer[(_name)->head];   \
+        __typeof__(&(_name)->buffer[0]) _pushed = RING_BUFFER_GET_NEXT(_name); \
+        if (RING_BUFFER_FULL(_name)) {                                        \
+            (_name)->tail = _RING_BUFFER_NEXT(_name, (_name)->tail);          \
+            (_name)->dropped++;                                               \
+        }                                                                     \
+        (_name)->head = _RING_BUFFER_NEXT(_name, (_name)->head);              \
+        _pushed;                                                              \
     })
 
 // Returns pointer to next element. Does NOT advance pointer
 // You must copy data yourself
-#define RING_BUFFER_GET_NEXT(_name) (&(_name)->buffer[(((_name)->head + 1) % (_name)->size)])
+#define RING_BUFFER_GET_NEXT(_name) (&(_name)->buffer[_RING_BUFFER_OFFSET(_name, (_name)->head)])
 
 // POPs item from ring buffer (NOTE: it does not check for empty queue)
 // and returns pointer to the item
-#define RING_BUFFER_POP(_name)                                      \
-    ({                                                              \
-        (_name)->tail = ((_name)->tail + 1) % (_name)->size;        \
-        (_name)->full = 0;                                          \
-        &(_name)->buffer[(_name)->tail];                            \
+#define RING_BUFFER_POP(_name)                                               \
+    ({                                                                       \
+        __typeof__(&(_name)->buffer[0]) _popped = RING_BUFFER_TAIL(_name);   \
+        (_name)->tail = _RING_BUFFER_NEXT(_name, (_name)->tail);             \
+        _popped;                                                             \
     })
 
 // Returns pointer to current tail
-#define RING_BUFFER_TAIL(_name) (&(_name)->buffer[((_name)->tail + 1) % (_name)->size])
+#define RING_BUFFER_TAIL(_name) (&(_name)->buffer[_RING_BUFFER_OFFSET(_name, (_name)->tail)])
 
 // Returns True if buffer is full
-#define RING_BUFFER_FULL(_name) ((_name)->full)
+#define RING_BUFFER_FULL(_name) (_RING_BUFFER_USED(_name) == RING_BUFFER_CAPACITY(_name))
+
+// Returns number of items in buffer
+#define RING_BUFFER_COUNT(_name) ((size_t)_RING_BUFFER_USED(_name))
+
+// Returns number of items which can be pushed without overwriting
+#define RING_BUFFER_FREE(_name) (RING_BUFFER_CAPACITY(_name) - RING_BUFFER_COUNT(_name))
+
+// Pushes "_count" items from "_items" array using at most 2 memcpy calls.
+// Same overwrite oldest policy as for single item push.
+// Returns number of items copied.
+#define RING_BUFFER_PUSH_BULK(_name, _items, _count)                                   \
+    ({                                                                                 \
+        const __typeof__((_name)->buffer[0])* _src = (_items);                         \
+        size_t _n = (_count);                                                          \
+        if (_n > RING_BUFFER_CAPACITY(_name)) {                                        \
+            /* Only last "capacity" items survive */                                   \
+            (_name)->dropped += _n - RING_BUFFER_CAPACITY(_name);                      \
+            _src += _n - RING_BUFFER_CAPACITY(_name);                                  \
+            _n = RING_BUFFER_CAPACITY(_name);                                          \
+        }                                                                              \
+        size_t _free = RING_BUFFER_FREE(_name);                                        \
+        if (_n > _free) {                                                              \
+            (_name)->tail = _RING_BUFFER_ADVANCE(_name, (_name)->tail, _n - _free);    \
+            (_name)->dropped += _n - _free;                                            \
+        }                                                                              \
+        size_t _pos = _RING_BUFFER_OFFSET(_name, (_name)->head);                       \
+        size_t _first = RING_BUFFER_CAPACITY(_name) - _pos;                            \
+        if (_first > _n) _first = _n;                                                  \
+        memcpy(&(_name)->buffer[_pos], _src, _first * sizeof(*_src));                  \
+        memcpy(&(_name)->buffer[0], _src + _first, (_n - _first) * sizeof(*_src));     \
+        (_name)->head = _RING_BUFFER_ADVANCE(_name, (_name)->head, _n);                \
+        _n;                                                                            \
+    })
+
+// Pops up to "_count" items into "_items" array using at most 2 memcpy calls.
+// Returns number of items copied.
+#define RING_BUFFER_POP_BULK(_name, _items, _count)                                    \
+    ({                                                                                 \
+        __typeof__((_name)->buffer[0])* _dst = (_items);                               \
+        size_t _n = (_count);                                                          \
+        size_t _used = RING_BUFFER_COUNT(_name);                                       \
+        if (_n > _used) _n = _used;                                                    \
+        size_t _pos = _RING_BUFFER_OFFSET(_name, (_name)->tail);                       \
+        size_t _first = RING_BUFFER_CAPACITY(_name) - _pos;                            \
+        if (_first > _n) _first = _n;                                                  \
+        memcpy(_dst, &(_name)->buffer[_pos], _first * sizeof(*_dst));                  \
+        memcpy(_dst + _first, &(_name)->buffer[0], (_n - _first) * sizeof(*_dst));     \
+        (_name)->tail = _RING_BUFFER_ADVANCE(_name, (_name)->tail, _n);                \
+        _n;                                                                            \
+    })
+
+// Returns number of items overwritten because buffer was full
+#define RING_BUFFER_DROPPED(_name) ((_name)->dropped)
 
 // Returns True if buffer is empty
-#define RING_BUFFER_EMPTY(_name) (!(_name)->full && (_name)->head == (_name)->tail)
+#define RING_BUFFER_EMPTY(_name) ((_name)->head == (_name)->tail)
 
 #endif
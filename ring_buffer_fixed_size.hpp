@@ -0,0 +1,169 @@
+// Copyright (c) Konstantin Belyalov. All rights reserved.
+// Licensed under the MIT license.
+//
+// C++ counterpart of ring_buffer_fixed_size.h: type safe fixed size ring
+// with compile time capacity. Header only, no heap, C++11.
+
+#ifndef __RING_BUFFER_FIXED_SIZE_HPP
+#define __RING_BUFFER_FIXED_SIZE_HPP
+
+#include <stddef.h>
+#include <algorithm>
+#include <iterator>
+#include <utility>
+
+namespace ring_buffer_detail {
+
+// Index math, selected at compile time by capacity:
+//  - power of two: free running indexes, bitmask wraparound
+//  - otherwise: indexes run in [0, 2 * N) range, compare / subtract only
+template <size_t N, bool Pow2 = ((N & (N - 1)) == 0)>
+struct index;
+
+template <size_t N>
+struct index<N, true> {
+  static size_t offset(size_t i) { return i & (N - 1); }
+  static size_t advance(size_t i, size_t n) { return i + n; }
+  static size_t used(size_t head, size_t tail) { return head - tail; }
+};
+
+template <size_t N>
+struct index<N, false> {
+  static size_t offset(size_t i) { return i >= N ? i - N : i; }
+  static size_t advance(size_t i, size_t n) { return i + n >= 2 * N ? i + n - 2 * N : i + n; }
+  static size_t used(size_t head, size_t tail) { return head >= tail ? head - tail : head + 2 * N - tail; }
+};
+
+}  // namespace ring_buffer_detail
+
+// T must be default constructible (storage is plain array, like C macros).
+template <typename T, size_t N>
+class ring_buffer_fixed_size {
+  static_assert(N > 0, "Ring capacity must be greater than zero");
+  typedef ring_buffer_detail::index<N> index;
+
+ public:
+  typedef T value_type;
+
+  // Forward iterator over live elements, from the oldest to the newest
+  template <typename Ring, typename V>
+  class iterator_base {
+   public:
+    typedef std::forward_iterator_tag iterator_category;
+    typedef V value_type;
+    typedef ptrdiff_t difference_type;
+    typedef V* pointer;
+    typedef V& reference;
+
+    iterator_base(Ring* ring, size_t pos) : ring_(ring), pos_(pos) {}
+    reference operator*() const { return ring_->buffer_[index::offset(pos_)]; }
+    pointer operator->() const { return &**this; }
+    iterator_base& operator++() { pos_ = index::advance(pos_, 1); return *this; }
+    iterator_base operator++(int) { iterator_base tmp = *this; ++*this; return tmp; }
+    bool operator==(const iterator_base& other) const { return pos_ == other.pos_; }
+    bool operator!=(const iterator_base& other) const { return pos_ != other.pos_; }
+
+   private:
+    Ring*  ring_;
+    size_t pos_;
+  };
+  typedef iterator_base<ring_buffer_fixed_size, T> iterator;
+  typedef iterator_base<const ring_buffer_fixed_size, const T> const_iterator;
+
+  ring_buffer_fixed_size() : head_(0), tail_(0) {}
+
+  static constexpr size_t capacity() { return N; }
+  size_t size() const { return index::used(head_, tail_); }
+  size_t free() const { return N - size(); }
+  bool   empty() const { return head_ == tail_; }
+  bool   full() const { return size() == N; }
+  void   clear() { head_ = tail_ = 0; }
+
+  // Oldest / newest items, ring must not be empty
+  T&       front() { return buffer_[index::offset(tail_)]; }
+  const T& front() const { return buffer_[index::offset(tail_)]; }
+  T&       back() { return buffer_[index::offset(index::advance(head_, 2 * N - 1))]; }
+  const T& back() const { return buffer_[index::offset(index::advance(head_, 2 * N - 1))]; }
+
+  // Push fails when ring is full
+  bool push(const T& item)
+  {
+    if (full()) {
+      return false;
+    }
+    buffer_[index::offset(head_)] = item;
+    head_ = index::advance(head_, 1);
+    return true;
+  }
+
+  bool push(T&& item)
+  {
+    if (full()) {
+      return false;
+    }
+    buffer_[index::offset(head_)] = std::move(item);
+    head_ = index::advance(head_, 1);
+    return true;
+  }
+
+  // Overwrite oldest item when full (same policy as RING_BUFFER_PUSH)
+  void push_overwrite(T item)
+  {
+    if (full()) {
+      tail_ = index::advance(tail_, 1);
+    }
+    buffer_[index::offset(head_)] = std::move(item);
+    head_ = index::advance(head_, 1);
+  }
+
+  // Moves the oldest item into "item". Returns false if ring is empty
+  bool pop(T& item)
+  {
+    if (empty()) {
+      return false;
+    }
+    item = std::move(buffer_[index::offset(tail_)]);
+    tail_ = index::advance(tail_, 1);
+    return true;
+  }
+
+  // Drops the oldest item (ring must not be empty)
+  void pop() { tail_ = index::advance(tail_, 1); }
+
+  // Bulk operations: move up to "count" items in at most 2 contiguous chunks
+  // (std::move on trivially copyable types is memmove).
+  // Return number of items actually moved.
+  size_t push_bulk(T* items, size_t count)
+  {
+    count = std::min(count, free());
+    size_t pos = index::offset(head_);
+    size_t first = std::min(count, N - pos);
+    std::move(items, items + first, &buffer_[pos]);
+    std::move(items + first, items + count, &buffer_[0]);
+    head_ = index::advance(head_, count);
+    return count;
+  }
+
+  size_t pop_bulk(T* items, size_t count)
+  {
+    count = std::min(count, size());
+    size_t pos = index::offset(tail_);
+    size_t first = std::min(count, N - pos);
+    std::move(&buffer_[pos], &buffer_[pos] + first, items);
+    std::move(&buffer_[0], &buffer_[0] + (count - first), items + first);
+    tail_ = index::advance(tail_, count);
+    return count;
+  }
+
+  iterator       begin() { return iterator(this, tail_); }
+  iterator       end() { return iterator(this, head_); }
+  const_iterator begin() const { return const_iterator(this, tail_); }
+  const_iterator end() const { return const_iterator(this, head_); }
+
+ private:
+  T      buffer_[N];
+  size_t head_;
+  size_t tail_;
+};
+
+#endif
@@ -1,113 +1,404 @@
+// Copyright (c) Konstantin Belyalov. All rights reserved.
+// Licensed under the MIT license.
+
 #include <stdlib.h>
+#include <string.h>
 #include "ring_buffer_nanopb.h"
 
-size_t pb_ring_buffer_metadata_used(struct ring_buffer_metadata* meta)
+
+static bool pb_istream_read_callback(pb_istream_t *istream, uint8_t *buf, size_t count)
 {
-  // No rollover
-  if (meta->head >= meta->tail) {
-    return meta->head - meta->tail;
-  }
+  return ring_buffer_read(istream->state, buf, count);
+}
 
-  // Buffer rolled over
-  return meta->size - meta->tail + meta->head;
+static bool pb_ostream_write_callback(pb_ostream_t* ostream, const uint8_t* buf, size_t count)
+{
+  return ring_buffer_write(ostream->state, buf, count);
 }
 
-size_t pb_ring_buffer_metadata_free(struct ring_buffer_metadata* meta)
+pb_istream_t pb_istream_from_ring_buffer(struct ring_buffer* meta, size_t msg_len)
 {
-  return meta->size - pb_ring_buffer_metadata_used(meta);
+  pb_istream_t stream;
+
+  stream.bytes_left = msg_len;
+  stream.callback = &pb_istream_read_callback;
+  stream.state  = meta;
+#ifndef PB_NO_ERRMSG
+  stream.errmsg = NULL;
+#endif
+
+  return stream;
 }
 
+pb_ostream_t pb_ostream_from_ring_buffer(struct ring_buffer* meta)
+{
+  pb_ostream_t stream;
 
-static bool pb_istream_read_callback(pb_istream_t *istream, uint8_t *buf, size_t count)
+  stream.bytes_written = 0;
+  stream.max_size = ring_buffer_free(meta);
+  stream.callback = &pb_ostream_write_callback;
+  stream.state = meta;
+#ifndef PB_NO_ERRMSG
+  stream.errmsg = NULL;
+#endif
+
+  return stream;
+}
+
+static bool pb_istream_buffered_callback(pb_istream_t* istream, uint8_t* buf, size_t count)
 {
-  struct ring_buffer_metadata* meta = istream->state;
+  struct pb_ring_buffer_istream* state = istream->state;
+  uint32_t avail = state->len - state->pos;
 
-  if (count == 0) {
+  // Fast path: tags / varints are served from window
+  if (count <= avail) {
+    memcpy(buf, &state->window[state->pos], count);
+    state->pos += count;
     return true;
   }
-  if (count > pb_ring_buffer_metadata_used(meta)) {
-    // Not enough data in the buffer
+
+  // Drain window first
+  memcpy(buf, &state->window[state->pos], avail);
+  buf += avail;
+  count -= avail;
+  state->pos = state->len = 0;
+  if (count > state->left) {
     return false;
   }
-
-  size_t tail_data_len = meta->size - meta->tail;
-
-  // If requested data length does not rollover buffer so can be
-  // done in single copy
-  if (count <= tail_data_len) {
-    memcpy(buf, &meta->buf[meta->tail], count);
-  } else {
-    // Copy data in 2 steps: remainder and the rest from the beginning
-    memcpy(buf, &meta->buf[meta->tail], tail_data_len);
-    buf += tail_data_len;
-    memcpy(buf, meta->buf, count - tail_data_len);
+  if (count >= sizeof(state->window)) {
+    // Large chunk (bytes / strings): directly from ring
+    state->left -= count;
+    return ring_buffer_read(state->ring, buf, count);
   }
 
-  // Update tail: we've read some data
-  meta->tail = (meta->tail + count) % meta->size;
+  // Refill window, but never beyond current message
+  uint32_t fill = state->left < sizeof(state->window) ? state->left : sizeof(state->window);
+  if (!ring_buffer_read(state->ring, state->window, fill)) {
+    return false;
+  }
+  state->left -= fill;
+  state->len = fill;
+  memcpy(buf, state->window, count);
+  state->pos = count;
 
   return true;
 }
 
-static bool pb_ostream_write_callback(pb_ostream_t* ostream, const uint8_t* buf, size_t count)
+pb_istream_t pb_istream_from_ring_buffer_buffered(struct pb_ring_buffer_istream* state,
+                                                  struct ring_buffer* meta, size_t msg_len)
 {
-  struct ring_buffer_metadata* meta = ostream->state;
+  pb_istream_t stream = pb_istream_from_ring_buffer(meta, msg_len);
+
+  state->ring = meta;
+  state->left = msg_len;
+  state->pos = 0;
+  state->len = 0;
+  stream.callback = &pb_istream_buffered_callback;
+  stream.state = state;
+
+  return stream;
+}
 
-  if (count == 0) {
+static bool pb_ostream_buffered_callback(pb_ostream_t* ostream, const uint8_t* buf, size_t count)
+{
+  struct pb_ring_buffer_ostream* state = ostream->state;
+
+  if (state->len + count <= sizeof(state->window)) {
+    memcpy(&state->window[state->len], buf, count);
+    state->len += count;
     return true;
   }
-  if (count > pb_ring_buffer_metadata_free(meta)) {
-    // Not enough free space in the buffer
+  if (!pb_ring_buffer_ostream_flush(state)) {
     return false;
   }
-
-  size_t remainder = meta->size - meta->head;
-  if (count <= remainder) {
-    // Buffer is not rolled over, copy everything
-    memcpy(&meta->buf[meta->head], buf, count);
-  } else {
-    // Rolled over buffer, 2 step data copy
-    // Data fragment till the buffer end
-    memcpy(&meta->buf[meta->head], buf, remainder);
-    buf += remainder;
-    // Second fragment is from beginning
-    memcpy(meta->buf, buf, count - remainder);
+  if (count >= sizeof(state->window)) {
+    return ring_buffer_write(state->ring, buf, count);
   }
-  // Update head: we've written some data
-  meta->head = (meta->head + count) % meta->size;
+  memcpy(state->window, buf, count);
+  state->len = count;
 
   return true;
 }
 
-pb_istream_t pb_istream_from_ring_buffer(struct ring_buffer_metadata* meta, size_t msg_len)
+pb_ostream_t pb_ostream_from_ring_buffer_buffered(struct pb_ring_buffer_ostream* state,
+                                                  struct ring_buffer* meta)
 {
-  pb_istream_t stream;
+  pb_ostream_t stream = pb_ostream_from_ring_buffer(meta);
 
-  stream.bytes_left = msg_len;
-  stream.callback = &pb_istream_read_callback;
-  stream.state  = meta;
+  state->ring = meta;
+  state->len = 0;
+  stream.callback = &pb_ostream_buffered_callback;
+  stream.state = state;
 
   return stream;
 }
 
-pb_ostream_t pb_ostream_from_ring_buffer(struct ring_buffer_metadata* meta)
+bool pb_ring_buffer_ostream_flush(struct pb_ring_buffer_ostream* state)
 {
+  bool res = ring_buffer_write(state->ring, state->window, state->len);
+
+  state->len = 0;
+  return res;
+}
+
+// Ring area accessed without moving head / tail: reserved (not yet
+// committed) area being written or peeked (not yet consumed) area being read.
+// Position is kept here rather than taken from stream counters since
+// nanopb encodes / decodes submessages through substreams with their own
+// counters.
+struct pb_ring_buffer_area {
+  struct ring_buffer_span spans[2];
+  uint32_t pos;
+};
+
+static bool pb_ostream_area_callback(pb_ostream_t* ostream, const uint8_t* buf, size_t count)
+{
+  struct pb_ring_buffer_area* area = ostream->state;
+  struct ring_buffer_span* spans = area->spans;
+  uint32_t pos = area->pos;
+
+  area->pos += count;
+  // Part of data which goes into the first span
+  if (pos < spans[0].len) {
+    uint32_t len = spans[0].len - pos;
+    if (len > count) {
+      len = count;
+    }
+    memcpy(&spans[0].buf[pos], buf, len);
+    buf += len;
+    count -= len;
+    pos = spans[0].len;
+  }
+  // Rest of data, rolled over to the beginning of ring
+  memcpy(&spans[1].buf[pos - spans[0].len], buf, count);
+
+  return true;
+}
+
+static bool pb_istream_area_callback(pb_istream_t* istream, uint8_t* buf, size_t count)
+{
+  struct pb_ring_buffer_area* area = istream->state;
+  struct ring_buffer_span* spans = area->spans;
+  uint32_t pos = area->pos;
+
+  area->pos += count;
+  if (pos < spans[0].len) {
+    uint32_t len = spans[0].len - pos;
+    if (len > count) {
+      len = count;
+    }
+    memcpy(buf, &spans[0].buf[pos], len);
+    buf += len;
+    count -= len;
+    pos = spans[0].len;
+  }
+  memcpy(buf, &spans[1].buf[pos - spans[0].len], count);
+
+  return true;
+}
+
+// Output stream over whole reserved area
+static pb_ostream_t pb_ostream_from_area(struct pb_ring_buffer_area* area, size_t size)
+{
+  if (area->spans[1].len == 0) {
+    // Area is contiguous: regular buffer stream, no callback overhead
+    return pb_ostream_from_buffer(area->spans[0].buf, size);
+  }
+
   pb_ostream_t stream;
 
+  area->pos = 0;
   stream.bytes_written = 0;
-  stream.max_size = meta->size;
-  stream.callback = &pb_ostream_write_callback;
-  stream.state = meta;
+  stream.max_size = size;
+  stream.callback = &pb_ostream_area_callback;
+  stream.state = area;
+#ifndef PB_NO_ERRMSG
+  stream.errmsg = NULL;
+#endif
+
+  return stream;
+}
+
+// Input stream over whole peeked area
+static pb_istream_t pb_istream_from_area(struct pb_ring_buffer_area* area, size_t size)
+{
+  if (area->spans[1].len == 0) {
+    return pb_istream_from_buffer(area->spans[0].buf, size);
+  }
+
+  pb_istream_t stream;
+
+  area->pos = 0;
+  stream.bytes_left = size;
+  stream.callback = &pb_istream_area_callback;
+  stream.state = area;
+#ifndef PB_NO_ERRMSG
+  stream.errmsg = NULL;
+#endif
 
   return stream;
 }
 
-void pb_ring_buffer_advance_tail(struct ring_buffer_metadata* meta, size_t len)
+static size_t pb_ring_buffer_varint_size(size_t value)
+{
+  size_t len = 1;
+
+  while (value >= 0x80) {
+    value >>= 7;
+    len++;
+  }
+
+  return len;
+}
+
+static bool pb_encode_to_ring_buffer_ex(struct ring_buffer* meta, const pb_msgdesc_t* fields,
+                                        const void* src_struct, bool delimited)
+{
+  struct pb_ring_buffer_area res;
+  size_t msg_len;
+
+  if (!pb_get_encoded_size(&msg_len, fields, src_struct)) {
+    return false;
+  }
+  size_t total = msg_len;
+  if (delimited) {
+    total += pb_ring_buffer_varint_size(msg_len);
+  }
+  if (ring_buffer_write_reserve(meta, total, res.spans) != total) {
+    // Does not fit, nothing written
+    return false;
+  }
+
+  pb_ostream_t stream = pb_ostream_from_area(&res, total);
+  if (delimited && !pb_encode_varint(&stream, msg_len)) {
+    return false;
+  }
+  if (!pb_encode(&stream, fields, src_struct) || stream.bytes_written != total) {
+    // Rollback: reserved area is simply not committed
+    return false;
+  }
+
+  return ring_buffer_write_commit(meta, total);
+}
+
+bool pb_encode_to_ring_buffer(struct ring_buffer* meta, const pb_msgdesc_t* fields, const void* src_struct)
+{
+  return pb_encode_to_ring_buffer_ex(meta, fields, src_struct, false);
+}
+
+bool pb_encode_delimited_to_ring_buffer(struct ring_buffer* meta, const pb_msgdesc_t* fields, const void* src_struct)
 {
-  meta->tail = (meta->tail + len) % meta->size;
+  return pb_encode_to_ring_buffer_ex(meta, fields, src_struct, true);
 }
 
-void pb_ring_buffer_advance_head(struct ring_buffer_metadata* meta, size_t len)
+bool pb_istream_from_ring_buffer_delimited(struct ring_buffer* meta, pb_istream_t* stream)
 {
-  meta->head = (meta->head + len) % meta->size;
+  uint32_t msg_len;
+
+  if (!ring_buffer_next_record_size(meta, &msg_len)) {
+    return false;
+  }
+  // Length prefix is always written in canonical (shortest) form
+  ring_buffer_read_consume(meta, pb_ring_buffer_varint_size(msg_len));
+  *stream = pb_istream_from_ring_buffer(meta, msg_len);
+
+  return true;
+}
+
+static bool pb_decode_from_ring_buffer_ex(struct ring_buffer* meta, size_t len, const pb_msgdesc_t* fields,
+                                          void* dst_struct, unsigned int flags)
+{
+  struct pb_ring_buffer_area area;
+
+  if (ring_buffer_read_peek(meta, len, area.spans) != len) {
+    return false;
+  }
+  pb_istream_t stream = pb_istream_from_area(&area, len);
+  bool res = pb_decode_ex(&stream, fields, dst_struct, flags);
+  // Message memory is not referenced anymore: release it (even malformed one)
+  ring_buffer_read_consume(meta, len);
+  if (!res) {
+    meta->dropped += len;
+  }
+
+  return res;
+}
+
+bool pb_decode_from_ring_buffer(struct ring_buffer* meta, size_t msg_len, const pb_msgdesc_t* fields, void* dst_struct)
+{
+  return pb_decode_from_ring_buffer_ex(meta, msg_len, fields, dst_struct, 0);
+}
+
+bool pb_decode_delimited_from_ring_buffer(struct ring_buffer* meta, const pb_msgdesc_t* fields, void* dst_struct)
+{
+  uint32_t msg_len;
+
+  if (!ring_buffer_next_record_size(meta, &msg_len)) {
+    return false;
+  }
+
+  return pb_decode_from_ring_buffer_ex(meta, pb_ring_buffer_varint_size(msg_len) + msg_len,
+                                       fields, dst_struct, PB_DECODE_DELIMITED);
+}
+
+size_t pb_encode_batch_to_ring_buffer(struct ring_buffer* meta, const pb_msgdesc_t* fields,
+                                      const void* src_array, size_t item_size, size_t count)
+{
+  struct pb_ring_buffer_area res;
+  const uint8_t* src = src_array;
+  size_t encoded = 0;
+  size_t committed = 0;
+
+  // Single stream over all free space, messages are published at once
+  uint32_t size = ring_buffer_write_reserve(meta, ring_buffer_free(meta), res.spans);
+  pb_ostream_t stream = pb_ostream_from_area(&res, size);
+
+  for (; encoded < count; encoded++) {
+    if (!pb_encode_ex(&stream, fields, src, PB_ENCODE_DELIMITED)) {
+      // Out of space: partially encoded message is not committed
+      break;
+    }
+    committed = stream.bytes_written;
+    src += item_size;
+  }
+  ring_buffer_write_commit(meta, committed);
+
+  return encoded;
+}
+
+size_t pb_decode_batch_from_ring_buffer(struct ring_buffer* meta, const pb_msgdesc_t* fields,
+                                        void* dst_array, size_t item_size, size_t count)
+{
+  struct pb_ring_buffer_area area;
+  uint8_t* dst = dst_array;
+  size_t decoded = 0;
+
+  // Single stream over all available data, consumed at once
+  uint32_t size = ring_buffer_read_peek(meta, ring_buffer_used(meta), area.spans);
+  pb_istream_t stream = pb_istream_from_area(&area, size);
+  size_t consumed = 0;
+
+  while (decoded < count && stream.bytes_left > 0) {
+    pb_istream_t substream;
+    if (!pb_make_string_substream(&stream, &substream)) {
+      // Incomplete message stays in ring
+      break;
+    }
+    bool res = pb_decode(&substream, fields, dst);
+    // Skips the rest of malformed message
+    if (!pb_close_string_substream(&stream, &substream)) {
+      break;
+    }
+    if (res) {
+      decoded++;
+      dst += item_size;
+    } else {
+      // Malformed message is dropped, otherwise it would block all the rest
+      meta->dropped += size - stream.bytes_left - consumed;
+    }
+    consumed = size - stream.bytes_left;
+  }
+  ring_buffer_read_consume(meta, consumed);
+
+  return decoded;
 }
@@ -6,6 +6,12 @@
 
 #include <pb_encode.h>
 #include <pb_decode.h>
+#include "ring_buffer.h"
+
+// Staging window size of buffered streams (bytes)
+#ifndef PB_RING_BUFFER_WINDOW_SIZE
+#define PB_RING_BUFFER_WINDOW_SIZE 32
+#endif
 
 #ifdef __cplusplus
 #define EXPORT extern "C"
@@ -13,18 +19,87 @@
 #define EXPORT
 #endif
 
-struct ring_buffer_metadata {
-  uint8_t* buf;
-  uint32_t tail;
-  uint32_t head;
-  uint32_t size;
+// NanoPB streams backed by struct ring_buffer.
+//
+// Output stream appends encoded data at ring head.
+//
+// Input stream consumes "msglen" bytes from ring tail, chunk by chunk through
+// callback: bytes are released from ring only after they are copied out.
+EXPORT pb_ostream_t pb_ostream_from_ring_buffer(struct ring_buffer* meta);
+EXPORT pb_istream_t pb_istream_from_ring_buffer(struct ring_buffer* meta, size_t msglen);
+
+// Zero copy decode of "msglen" bytes message: message is decoded straight out
+// of ring memory (no bounce copy, wrapped message is read across both parts)
+// and released from ring only after decoding is done, so producer (ISR,
+// ring_buffer_dma, ring_buffer_cobs decoder) may keep writing meanwhile.
+// Returns false when ring has less than "msglen" bytes (ring untouched) or
+// when decode failed (malformed message is dropped and counted in ring
+// "dropped").
+EXPORT bool pb_decode_from_ring_buffer(struct ring_buffer* meta, size_t msglen, const pb_msgdesc_t* fields, void* dst_struct);
+
+// Transactional encode: message is either written completely or not at all.
+// Encoded size is computed upfront (pb_get_encoded_size), space is reserved,
+// message is encoded into reserved area and published with a single commit.
+// If message does not fit / encode fails ring remains untouched.
+// (unlike pb_ostream_from_ring_buffer() which may leave partially written
+// message in ring on failure).
+EXPORT bool pb_encode_to_ring_buffer(struct ring_buffer* meta, const pb_msgdesc_t* fields, const void* src_struct);
+
+// Same as above, but message is prefixed by varint encoded length, i.e.
+// it is ring_buffer record (see ring_buffer_write_record()) and
+// nanopb delimited message (pb_decode_ex(..., PB_DECODE_DELIMITED)) at once.
+EXPORT bool pb_encode_delimited_to_ring_buffer(struct ring_buffer* meta, const pb_msgdesc_t* fields, const void* src_struct);
+
+// Reader side for length prefixed messages: consumes length prefix and
+// creates input stream for message which follows it.
+// Returns false (ring untouched) when there is no complete message in ring.
+EXPORT bool pb_istream_from_ring_buffer_delimited(struct ring_buffer* meta, pb_istream_t* stream);
+// Zero copy version, see pb_decode_from_ring_buffer().
+EXPORT bool pb_decode_delimited_from_ring_buffer(struct ring_buffer* meta, const pb_msgdesc_t* fields, void* dst_struct);
+
+// Batch API: array of messages ("item_size" bytes apart, e.g. sizeof(msg))
+// as delimited (length prefixed) messages in one pass, with single stream.
+//
+// Encodes as many messages as fit into ring (all of them are published with
+// single commit). Returns number of messages encoded.
+EXPORT size_t pb_encode_batch_to_ring_buffer(struct ring_buffer* meta, const pb_msgdesc_t* fields,
+                                             const void* src_array, size_t item_size, size_t count);
+// Decodes up to "count" messages. Returns number of messages decoded,
+// messages decoded are consumed from ring. Malformed (but complete) message
+// is dropped and counted in ring "dropped" (bytes), incomplete message stays
+// in ring.
+EXPORT size_t pb_decode_batch_from_ring_buffer(struct ring_buffer* meta, const pb_msgdesc_t* fields,
+                                               void* dst_array, size_t item_size, size_t count);
+
+// Buffered streams: nanopb reads / writes tags and varints byte by byte,
+// callback streams do ring_buffer_read() / write() for each of them. Buffered
+// streams serve these small requests from linear staging window which is
+// refilled / flushed in bulk, requests not smaller than window go to ring
+// directly. Relative cost vs callback streams is not measured yet, see
+// test/bench_ring_nanopb.c. State must outlive the stream.
+struct pb_ring_buffer_istream {
+  struct ring_buffer* ring;
+  uint32_t left;      // Message bytes not yet fetched from ring
+  uint32_t pos;
+  uint32_t len;
+  uint8_t  window[PB_RING_BUFFER_WINDOW_SIZE];
 };
 
-EXPORT pb_ostream_t pb_ostream_from_ring_buffer(struct ring_buffer_metadata* meta);
-EXPORT pb_istream_t pb_istream_from_ring_buffer(struct ring_buffer_metadata* meta, size_t msglen);
-EXPORT size_t       pb_ring_buffer_metadata_used(struct ring_buffer_metadata* meta);
-EXPORT size_t       pb_ring_buffer_metadata_free(struct ring_buffer_metadata* meta);
-EXPORT void         pb_ring_buffer_advance_tail(struct ring_buffer_metadata* meta, size_t len);
-EXPORT void         pb_ring_buffer_advance_head(struct ring_buffer_metadata* meta, size_t len);
+struct pb_ring_buffer_ostream {
+  struct ring_buffer* ring;
+  uint32_t len;
+  uint8_t  window[PB_RING_BUFFER_WINDOW_SIZE];
+};
+
+// Same as pb_istream_from_ring_buffer(). Window is filled only with bytes of
+// this message.
+EXPORT pb_istream_t pb_istream_from_ring_buffer_buffered(struct pb_ring_buffer_istream* state,
+                                                         struct ring_buffer* meta, size_t msglen);
+
+// Same as pb_ostream_from_ring_buffer(). Data becomes visible in ring only
+// after pb_ring_buffer_ostream_flush().
+EXPORT pb_ostream_t pb_ostream_from_ring_buffer_buffered(struct pb_ring_buffer_ostream* state,
+                                                         struct ring_buffer* meta);
+EXPORT bool pb_ring_buffer_ostream_flush(struct pb_ring_buffer_ostream* state);
 
 #endif
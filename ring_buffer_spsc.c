@@ -0,0 +1,105 @@
+// Copyright (c) Konstantin Belyalov. All rights reserved.
+// Licensed under the MIT license.
+
+#include <string.h>
+#include "ring_buffer_spsc.h"
+
+// Memory ordering:
+// - each side reads its own index relaxed (nobody else writes it)
+// - other side's index is loaded with acquire, so data it published is visible
+// - own index is stored with release, only after data has been copied
+// GCC __atomic builtins are used (instead of <stdatomic.h>) to keep struct
+// fields plain uint32_t, so header is usable from C++ as well.
+// On Cortex-M 32 bit atomic load / store compile into ldr/str + dmb.
+#define LOAD_OWN(p)      __atomic_load_n(p, __ATOMIC_RELAXED)
+#define LOAD_OTHER(p)    __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define PUBLISH(p, v)    __atomic_store_n(p, v, __ATOMIC_RELEASE)
+
+
+bool ring_buffer_spsc_init(struct ring_buffer_spsc* meta, uint8_t* buf, uint32_t buf_size)
+{
+  if (buf_size == 0 || (buf_size & (buf_size - 1)) != 0) {
+    // Only power of two sizes are supported
+    return false;
+  }
+  meta->buf = buf;
+  meta->size = buf_size;
+  meta->head = 0;
+  meta->tail = 0;
+
+  return true;
+}
+
+bool ring_buffer_spsc_write(struct ring_buffer_spsc* meta, const uint8_t* buf, uint32_t write_size)
+{
+  if (write_size == 0) {
+    return true;
+  }
+
+  uint32_t head = LOAD_OWN(&meta->head);
+  uint32_t tail = LOAD_OTHER(&meta->tail);
+  if (write_size > meta->size - (head - tail)) {
+    // Not enough free space in the buffer
+    return false;
+  }
+
+  uint32_t offset = head & (meta->size - 1);
+  uint32_t remainder = meta->size - offset;
+  if (write_size <= remainder) {
+    memcpy(&meta->buf[offset], buf, write_size);
+  } else {
+    // Rolled over buffer, 2 step data copy
+    memcpy(&meta->buf[offset], buf, remainder);
+    memcpy(meta->buf, buf + remainder, write_size - remainder);
+  }
+
+  // Make data visible to consumer
+  PUBLISH(&meta->head, head + write_size);
+
+  return true;
+}
+
+bool ring_buffer_spsc_read(struct ring_buffer_spsc* meta, uint8_t* buf, uint32_t read_size)
+{
+  if (read_size == 0) {
+    return true;
+  }
+
+  uint32_t tail = LOAD_OWN(&meta->tail);
+  uint32_t head = LOAD_OTHER(&meta->head);
+  if (read_size > head - tail) {
+    // Not enough data in the buffer
+    return false;
+  }
+
+  uint32_t offset = tail & (meta->size - 1);
+  uint32_t tail_data_len = meta->size - offset;
+  if (read_size <= tail_data_len) {
+    memcpy(buf, &meta->buf[offset], read_size);
+  } else {
+    // Copy data in 2 steps: remainder and the rest from the beginning
+    memcpy(buf, &meta->buf[offset], tail_data_len);
+    memcpy(buf + tail_data_len, meta->buf, read_size - tail_data_len);
+  }
+
+  // Give space back to producer
+  PUBLISH(&meta->tail, tail + read_size);
+
+  return true;
+}
+
+uint32_t ring_buffer_spsc_used(struct ring_buffer_spsc* meta)
+{
+  uint32_t tail = LOAD_OWN(&meta->tail);
+  uint32_t head = LOAD_OTHER(&meta->head);
+
+  return head - tail;
+}
+
+uint32_t ring_buffer_spsc_free(struct ring_buffer_spsc* meta)
+{
+  uint32_t head = LOAD_OWN(&meta->head);
+  uint32_t tail = LOAD_OTHER(&meta->tail);
+
+  return meta->size - (head - tail);
+}
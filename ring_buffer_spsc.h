@@ -0,0 +1,40 @@
+// Copyright (c) Konstantin Belyalov. All rights reserved.
+// Licensed under the MIT license.
+
+#ifndef __RING_BUFFER_SPSC_H
+#define __RING_BUFFER_SPSC_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+#define EXPORT extern "C"
+#else
+#define EXPORT
+#endif
+
+// Lock free single producer / single consumer ring buffer.
+// Producer (e.g. UART RX ISR) owns "head", consumer (e.g. task) owns "tail",
+// so no interrupt masking / mutex is required as long as there is exactly
+// one writer and one reader.
+// Both indexes are free running (never wrapped), therefore buffer size must
+// be power of two.
+struct ring_buffer_spsc {
+  uint8_t* buf;
+  uint32_t size;
+  uint32_t head;
+  uint32_t tail;
+};
+
+// Returns false if buf_size is not power of two
+EXPORT bool     ring_buffer_spsc_init(struct ring_buffer_spsc* meta, uint8_t* buf, uint32_t buf_size);
+
+// Producer side
+EXPORT bool     ring_buffer_spsc_write(struct ring_buffer_spsc* meta, const uint8_t* buf, uint32_t write_size);
+EXPORT uint32_t ring_buffer_spsc_free(struct ring_buffer_spsc* meta);
+
+// Consumer side
+EXPORT bool     ring_buffer_spsc_read(struct ring_buffer_spsc* meta, uint8_t* buf, uint32_t read_size);
+EXPORT uint32_t ring_buffer_spsc_used(struct ring_buffer_spsc* meta);
+
+#endif
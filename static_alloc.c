@@ -5,164 +5,1101 @@
 
 #include "static_alloc.h"
 
-// Use mutex for alloc/free operation under freertos
-#ifdef STATIC_ALLOC_FREERTOS
-#include "FreeRTOS.h"
-#include "semphr.h"
-static SemaphoreHandle_t  _mutex;
-static StaticSemaphore_t  _mutex_buffer;
-#endif
-
 
 struct static_alloc_item {
   uint16_t refcount;
   uint16_t blocks_used;
 };
 
-static uint32_t* _blocks_status;
-static uint8_t*  _blocks_user_data;
-static uint32_t  _blocks_count;
+// Item of size class pool: blocks_used holds flag and class index
+#define ITEM_CLASS_FLAG           0x8000
+// Regular item size limit (blocks_used without class flag), i.e. 2MB pool
+// for 64 bytes blocks
+#define MAX_BLOCKS                (ITEM_CLASS_FLAG - 1)
+// Regular item size limit in bytes. Sizes above it must be rejected before
+// BLOCKS_FOR(): it wraps around for sizes close to UINT32_MAX on 32 bit targets
+#define MAX_ITEM_SIZE             (MAX_BLOCKS * STATIC_ALLOC_BLOCK_SIZE - sizeof(struct static_alloc_item))
+// Blocks required for item of "size" bytes
+#define BLOCKS_FOR(size)          (((size) + sizeof(struct static_alloc_item) + STATIC_ALLOC_BLOCK_SIZE - 1) / STATIC_ALLOC_BLOCK_SIZE)
 
-#define MARK_BLOCK_AS_USED(n)     do { _blocks_status[n / 32] &= ~(1 << (n & 31)); } while(0)
-#define MARK_BLOCK_AS_FREE(n)     do { _blocks_status[n / 32] |= 1 << (n & 31); } while(0)
-#define IS_BLOCK_FREE(n)          (_blocks_status[n / 32] & (1 << (n & 31)))
+// Short critical section: protects size class free lists (which are used
+// from interrupts as well) and reference counters on ARMv6-M.
+// PRIMASK exists only on Cortex-M (M profile), any other target (host
+// unittests included) takes spinlock.
+#if defined(__ARM_ARCH_PROFILE) && __ARM_ARCH_PROFILE == 'M'
+static inline uint32_t static_alloc_critical_enter(void)
+{
+  uint32_t primask;
+  __asm volatile ("mrs %0, primask\n cpsid i" : "=r" (primask) :: "memory");
+  return primask;
+}
 
+static inline void static_alloc_critical_exit(uint32_t primask)
+{
+  __asm volatile ("msr primask, %0" :: "r" (primask) : "memory");
+}
+#else
+// Host build (unittests): "interrupts" are threads, spinlock instead
+static uint8_t _critical_lock;
 
-void static_alloc_init(uint8_t* buf, uint32_t buf_size)
+static inline uint32_t static_alloc_critical_enter(void)
+{
+  while (__atomic_test_and_set(&_critical_lock, __ATOMIC_ACQUIRE)) {
+  }
+  return 0;
+}
+
+static inline void static_alloc_critical_exit(uint32_t state)
+{
+  (void)state;
+  __atomic_clear(&_critical_lock, __ATOMIC_RELEASE);
+}
+#endif
+
+// Reference counting is lock free: allocator lock is taken only when the last
+// reference is released. Targets without lock free 16 bit atomics (ARMv6-M,
+// i.e. Cortex-M0/M0+, has no exclusive access instructions) would get
+// __sync_* libcalls instead, so there it is done in critical section.
+#if __GCC_ATOMIC_SHORT_LOCK_FREE != 2
+static inline void static_alloc_ref_inc(struct static_alloc_item* item)
+{
+  uint32_t state = static_alloc_critical_enter();
+  item->refcount++;
+  static_alloc_critical_exit(state);
+}
+
+// Returns true when the last reference has been released
+static inline bool static_alloc_ref_dec(struct static_alloc_item* item)
+{
+  uint32_t state = static_alloc_critical_enter();
+  uint16_t prev = item->refcount;
+  if (prev > 0) {
+    item->refcount = prev - 1;
+  }
+  static_alloc_critical_exit(state);
+  return prev == 1;
+}
+
+// Releases reference unless it is the last one.
+// Returns true when it is the last one (kept untouched)
+static inline bool static_alloc_ref_drop(struct static_alloc_item* item)
+{
+  uint32_t state = static_alloc_critical_enter();
+  uint16_t prev = item->refcount;
+  if (prev > 1) {
+    item->refcount = prev - 1;
+  }
+  static_alloc_critical_exit(state);
+  return prev == 1;
+}
+#else
+static inline void static_alloc_ref_inc(struct static_alloc_item* item)
+{
+  __atomic_fetch_add(&item->refcount, 1, __ATOMIC_RELAXED);
+}
+
+static inline bool static_alloc_ref_dec(struct static_alloc_item* item)
+{
+  uint16_t prev = __atomic_load_n(&item->refcount, __ATOMIC_RELAXED);
+
+  // Already released item is not touched
+  do {
+    if (prev == 0) {
+      return false;
+    }
+  } while (!__atomic_compare_exchange_n(&item->refcount, &prev, prev - 1, true,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_RELAXED));
+  return prev == 1;
+}
+
+static inline bool static_alloc_ref_drop(struct static_alloc_item* item)
+{
+  uint16_t prev = __atomic_load_n(&item->refcount, __ATOMIC_ACQUIRE);
+
+  do {
+    if (prev <= 1) {
+      return prev == 1;
+    }
+  } while (!__atomic_compare_exchange_n(&item->refcount, &prev, prev - 1, true,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+  return false;
+}
+#endif
+
+// Default arena, used by static_alloc_* functions
+static struct static_alloc_arena _default_arena;
+
+#ifdef STATIC_ALLOC_TRACE
+#ifndef STATIC_ALLOC_TRACE_TIMESTAMP
+#define STATIC_ALLOC_TRACE_TIMESTAMP()  0
+#endif
+
+static struct ring_buffer* _trace_ring;
+
+// Records event of default arena. Ring may be written from interrupts as
+// well, so it is done in critical section.
+static void static_alloc_trace(struct static_alloc_arena* arena, uint8_t op, uint8_t flags,
+                               shared_void* ptr, uint32_t size)
+{
+  struct static_alloc_trace_event event;
+  uint8_t* data = arena->blocks_user_data;
+
+  if (arena != &_default_arena || _trace_ring == NULL) {
+    return;
+  }
+  if (ptr && ((uint8_t*)ptr < data || (uint8_t*)ptr >= data + arena->blocks_count * STATIC_ALLOC_BLOCK_SIZE)) {
+    // Item of another arena (static_alloc_copy())
+    return;
+  }
+  event.timestamp = STATIC_ALLOC_TRACE_TIMESTAMP();
+  event.size = size;
+  event.block = STATIC_ALLOC_TRACE_NO_BLOCK;
+  if (ptr) {
+    event.block = ((uint8_t*)ptr - sizeof(struct static_alloc_item) - data) / STATIC_ALLOC_BLOCK_SIZE;
+  }
+  event.op = op;
+  event.flags = flags;
+
+  uint32_t state = static_alloc_critical_enter();
+  if (_trace_ring && !ring_buffer_write(_trace_ring, (uint8_t*)&event, sizeof(event))) {
+    _trace_ring->dropped += sizeof(event);
+  }
+  static_alloc_critical_exit(state);
+}
+
+void static_alloc_trace_start(struct ring_buffer* ring)
+{
+  _trace_ring = ring;
+}
+
+#define STATIC_ALLOC_TRACE_EVENT(...)   static_alloc_trace(__VA_ARGS__)
+#else
+#define STATIC_ALLOC_TRACE_EVENT(...)
+#endif
+
+#define IS_BLOCK_FREE(a, n)       ((a)->blocks_status[(n) / 32] & (1U << ((n) & 31)))
+
+#ifndef STATIC_ALLOC_BUDDY
+// Bitmap backend //
+
+// Number of status words (bit set - block is free).
+// Bits past the last block are never set, i.e. they look like used blocks.
+#define STATUS_WORDS(a)           (((a)->blocks_count + 31) / 32)
+
+// Marks "count" blocks starting from "first" as free / used, word at a time
+static void static_alloc_mark_blocks(struct static_alloc_arena* arena, uint32_t first, uint32_t count, int free)
+{
+  while (count > 0) {
+    uint32_t bit = first & 31;
+    uint32_t len = 32 - bit < count ? 32 - bit : count;
+    uint32_t mask = (len == 32 ? 0xFFFFFFFFU : ((1U << len) - 1)) << bit;
+    if (free) {
+      arena->blocks_status[first / 32] |= mask;
+    } else {
+      arena->blocks_status[first / 32] &= ~mask;
+    }
+    first += len;
+    count -= len;
+  }
+}
+
+// Returns true when all "count" blocks starting from "first" are free
+static bool static_alloc_blocks_free(struct static_alloc_arena* arena, uint32_t first, uint32_t count)
+{
+  if (first + count > arena->blocks_count) {
+    return false;
+  }
+  while (count > 0) {
+    uint32_t bit = first & 31;
+    uint32_t len = 32 - bit < count ? 32 - bit : count;
+    uint32_t mask = (len == 32 ? 0xFFFFFFFFU : ((1U << len) - 1)) << bit;
+    if ((arena->blocks_status[first / 32] & mask) != mask) {
+      return false;
+    }
+    first += len;
+    count -= len;
+  }
+  return true;
+}
+
+// Longest run of free blocks, for stats only: scans whole bitmap
+static uint32_t static_alloc_largest_free(struct static_alloc_arena* arena)
+{
+  uint32_t largest = 0;
+  uint32_t run = 0;
+
+  for (uint32_t w = 0; w < STATUS_WORDS(arena); w++) {
+    uint32_t word = arena->blocks_status[w];
+
+    if (word == 0xFFFFFFFFU) {
+      run += 32;
+      continue;
+    }
+    // Run which began in previous words ends here
+    run += __builtin_ctz(~word);
+    if (run > largest) {
+      largest = run;
+    }
+    // Runs inside of word
+    uint32_t len = 0;
+    for (uint32_t x = word; x != 0; x &= x >> 1) {
+      len++;
+    }
+    if (len > largest) {
+      largest = len;
+    }
+    run = __builtin_clz(~word);
+  }
+
+  return run > largest ? run : largest;
+}
+
+// Bit i of result is set when bits i .. i + n - 1 of "word" are all set
+// (n <= 32), log2(n) shift / and steps.
+static inline uint32_t static_alloc_runs_of(uint32_t word, uint32_t n)
+{
+  uint32_t have = 1;
+
+  while (have < n && word != 0) {
+    uint32_t step = have < n - have ? have : n - have;
+    word &= word >> step;
+    have += step;
+  }
+  return word;
+}
+
+// First fit search of "required" consecutive free blocks.
+// Scans status word by word:
+//  - all free / all used words are skipped at once
+//  - mixed word: its low free bits (count trailing ones) extend run from
+//    previous words, runs entirely inside of word are found by shift / and,
+//    its high free bits (count leading ones) start new run.
+// Search starts from status word "from".
+// Returns index of first block or -1 if there is no such run.
+static int32_t static_alloc_find_blocks(struct static_alloc_arena* arena, uint32_t required, uint32_t from)
+{
+  uint32_t run = 0;
+  uint32_t start = 0;
+
+  for (uint32_t w = from; w < STATUS_WORDS(arena); w++) {
+    uint32_t word = arena->blocks_status[w];
+
+    if (word == 0xFFFFFFFFU) {
+      if (run == 0) {
+        start = w * 32;
+      }
+      run += 32;
+      if (run >= required) {
+        return start;
+      }
+      continue;
+    }
+    if (word == 0) {
+      run = 0;
+      continue;
+    }
+
+    // Run which began in previous words (word is not all ones: ~word != 0)
+    if (run > 0) {
+      run += __builtin_ctz(~word);
+      if (run >= required) {
+        return start;
+      }
+    }
+    // Run inside of word. Low bits run has been checked already, it is too short.
+    if (required <= 32) {
+      uint32_t runs = static_alloc_runs_of(word, required);
+      if (runs) {
+        return w * 32 + __builtin_ctz(runs);
+      }
+    }
+    // Run reaching the end of word, continues in the next one
+    run = __builtin_clz(~word);
+    start = w * 32 + 32 - run;
+  }
+
+  return -1;
+}
+
+// Finds the next run of free blocks starting at / after "*block".
+// Returns false when there are no more free blocks.
+static bool static_alloc_next_run(struct static_alloc_arena* arena, uint32_t* block, uint32_t* len)
+{
+  uint32_t b = *block;
+
+  // First free block: skip used blocks, a word at a time
+  while (b < arena->blocks_count) {
+    uint32_t word = arena->blocks_status[b / 32] >> (b & 31);
+    if (word) {
+      b += __builtin_ctz(word);
+      break;
+    }
+    b = (b | 31) + 1;
+  }
+  if (b >= arena->blocks_count) {
+    return false;
+  }
+  *block = b;
+  // First used block. Bits past the last block look used: run ends there.
+  while (b < arena->blocks_count) {
+    uint32_t word = ~arena->blocks_status[b / 32] >> (b & 31);
+    if (word) {
+      b += __builtin_ctz(word);
+      break;
+    }
+    b = (b | 31) + 1;
+  }
+  *len = (b < arena->blocks_count ? b : arena->blocks_count) - *block;
+
+  return true;
+}
+
+// Best fit: the smallest free run which fits, keeps large runs intact
+static int32_t static_alloc_best_fit(struct static_alloc_arena* arena, uint32_t required)
+{
+  int32_t best = -1;
+  uint32_t best_len = 0;
+  uint32_t block = 0;
+  uint32_t len;
+
+  while (static_alloc_next_run(arena, &block, &len)) {
+    if (len >= required && (best < 0 || len < best_len)) {
+      best = block;
+      best_len = len;
+      if (len == required) {
+        // Exact fit, can't be better
+        break;
+      }
+    }
+    block += len;
+  }
+
+  return best;
+}
+
+// Top fit: the end of the last run which fits. Long lived items are packed
+// at the top of pool, away from short lived ones.
+static int32_t static_alloc_top_fit(struct static_alloc_arena* arena, uint32_t required)
+{
+  int32_t top = -1;
+  uint32_t block = 0;
+  uint32_t len;
+
+  while (static_alloc_next_run(arena, &block, &len)) {
+    if (len >= required) {
+      top = block + len - required;
+    }
+    block += len;
+  }
+
+  return top;
+}
+
+static void static_alloc_backend_init(struct static_alloc_arena* arena)
+{
+  // All free
+  static_alloc_mark_blocks(arena, 0, arena->blocks_count, 1);
+}
+
+// Blocks actually taken by item of "required" blocks
+static inline uint32_t static_alloc_backend_blocks(uint32_t required)
+{
+  return required;
+}
+
+// Returns index of the first block or -1 when out of memory
+static int32_t static_alloc_backend_alloc(struct static_alloc_arena* arena, uint32_t blocks, uint32_t flags)
+{
+  int32_t first_block;
+
+  if (flags & STATIC_ALLOC_LONG_LIVED) {
+    first_block = static_alloc_top_fit(arena, blocks);
+  } else if (arena->policy == STATIC_ALLOC_BEST_FIT) {
+    first_block = static_alloc_best_fit(arena, blocks);
+  } else if (arena->policy == STATIC_ALLOC_NEXT_FIT) {
+    // Search from roving pointer, then from the beginning
+    first_block = static_alloc_find_blocks(arena, blocks, arena->rover);
+    if (first_block < 0 && arena->rover > 0) {
+      first_block = static_alloc_find_blocks(arena, blocks, 0);
+    }
+    if (first_block >= 0) {
+      arena->rover = (first_block + blocks) / 32;
+      if (arena->rover >= STATUS_WORDS(arena)) {
+        arena->rover = 0;
+      }
+    }
+  } else {
+    first_block = static_alloc_find_blocks(arena, blocks, 0);
+  }
+  if (first_block >= 0) {
+    // Mark all these blocks as used
+    static_alloc_mark_blocks(arena, first_block, blocks, 0);
+  }
+
+  return first_block;
+}
+
+static void static_alloc_backend_free(struct static_alloc_arena* arena, uint32_t first, uint32_t blocks)
+{
+  static_alloc_mark_blocks(arena, first, blocks, 1);
+}
+
+// In place resize: releases trailing blocks / takes free blocks right after item
+static bool static_alloc_backend_resize(struct static_alloc_arena* arena, uint32_t first, uint32_t blocks, uint32_t required)
+{
+  if (required <= blocks) {
+    static_alloc_mark_blocks(arena, first + required, blocks - required, 1);
+    return true;
+  }
+  if (static_alloc_blocks_free(arena, first + blocks, required - blocks)) {
+    static_alloc_mark_blocks(arena, first + blocks, required - blocks, 0);
+    return true;
+  }
+
+  return false;
+}
+
+static uint32_t static_alloc_backend_free_blocks(struct static_alloc_arena* arena)
+{
+  uint32_t free = 0;
+
+  for (uint32_t w = 0; w < STATUS_WORDS(arena); w++) {
+    free += __builtin_popcount(arena->blocks_status[w]);
+  }
+  return free;
+}
+
+#else
+// Buddy backend //
+//
+// Pool is split into power of two sized chunks (in blocks), aligned to their
+// size. Free chunks of every order are kept in doubly linked lists stored in
+// chunk memory itself, status bit is set for the first block of free chunk.
+// Alloc takes chunk of the smallest non empty order and splits it in halves,
+// free merges chunk with its buddy (chunk ^ size) while buddy is free chunk
+// of the same order: both are O(orders), no bitmap scan.
+// Pool of not power of two blocks is split into several top level chunks.
+
+struct static_alloc_buddy_chunk {
+  struct static_alloc_buddy_chunk* next;
+  struct static_alloc_buddy_chunk* prev;
+  uint32_t order;
+};
+
+static inline struct static_alloc_buddy_chunk* static_alloc_buddy_at(struct static_alloc_arena* arena, uint32_t block)
+{
+  return (struct static_alloc_buddy_chunk*)(arena->blocks_user_data + block * STATIC_ALLOC_BLOCK_SIZE);
+}
+
+static void static_alloc_buddy_push(struct static_alloc_arena* arena, uint32_t block, uint32_t order)
+{
+  struct static_alloc_buddy_chunk* chunk = static_alloc_buddy_at(arena, block);
+
+  chunk->order = order;
+  chunk->prev = NULL;
+  chunk->next = arena->buddy_free[order];
+  if (chunk->next) {
+    chunk->next->prev = chunk;
+  }
+  arena->buddy_free[order] = chunk;
+  arena->blocks_status[block / 32] |= 1U << (block & 31);
+  arena->buddy_free_blocks += 1U << order;
+}
+
+static void static_alloc_buddy_remove(struct static_alloc_arena* arena, uint32_t block)
+{
+  struct static_alloc_buddy_chunk* chunk = static_alloc_buddy_at(arena, block);
+
+  if (chunk->prev) {
+    chunk->prev->next = chunk->next;
+  } else {
+    arena->buddy_free[chunk->order] = chunk->next;
+  }
+  if (chunk->next) {
+    chunk->next->prev = chunk->prev;
+  }
+  arena->blocks_status[block / 32] &= ~(1U << (block & 31));
+  arena->buddy_free_blocks -= 1U << chunk->order;
+}
+
+// Returns true when "block" starts free chunk of "order"
+static inline bool static_alloc_buddy_is_free(struct static_alloc_arena* arena, uint32_t block, uint32_t order)
+{
+  return block + (1U << order) <= arena->blocks_count && IS_BLOCK_FREE(arena, block) &&
+         static_alloc_buddy_at(arena, block)->order == order;
+}
+
+static inline uint32_t static_alloc_buddy_order(uint32_t blocks)
+{
+  return blocks <= 1 ? 0 : 32 - __builtin_clz(blocks - 1);
+}
+
+static void static_alloc_backend_init(struct static_alloc_arena* arena)
+{
+  for (uint32_t i = 0; i < STATIC_ALLOC_BUDDY_ORDERS; i++) {
+    arena->buddy_free[i] = NULL;
+  }
+  arena->buddy_free_blocks = 0;
+  // The largest chunks aligned to their size
+  for (uint32_t block = 0; block < arena->blocks_count; ) {
+    uint32_t order = block ? __builtin_ctz(block) : STATIC_ALLOC_BUDDY_ORDERS - 1;
+    if (order > STATIC_ALLOC_BUDDY_ORDERS - 1) {
+      order = STATIC_ALLOC_BUDDY_ORDERS - 1;
+    }
+    while (block + (1U << order) > arena->blocks_count) {
+      order--;
+    }
+    static_alloc_buddy_push(arena, block, order);
+    block += 1U << order;
+  }
+}
+
+static inline uint32_t static_alloc_backend_blocks(uint32_t required)
+{
+  return 1U << static_alloc_buddy_order(required);
+}
+
+static int32_t static_alloc_backend_alloc(struct static_alloc_arena* arena, uint32_t blocks, uint32_t flags)
+{
+  uint32_t order = static_alloc_buddy_order(blocks);
+  uint32_t k = order;
+
+  (void)flags;
+  while (k < STATIC_ALLOC_BUDDY_ORDERS && arena->buddy_free[k] == NULL) {
+    k++;
+  }
+  if (k >= STATIC_ALLOC_BUDDY_ORDERS) {
+    return -1;
+  }
+  uint32_t block = ((uint8_t*)arena->buddy_free[k] - arena->blocks_user_data) / STATIC_ALLOC_BLOCK_SIZE;
+  static_alloc_buddy_remove(arena, block);
+  // Split: upper halves go to free lists
+  while (k > order) {
+    k--;
+    static_alloc_buddy_push(arena, block + (1U << k), k);
+  }
+
+  return block;
+}
+
+static void static_alloc_backend_free(struct static_alloc_arena* arena, uint32_t first, uint32_t blocks)
+{
+  uint32_t order = static_alloc_buddy_order(blocks);
+
+  // Coalesce with free buddies
+  while (order < STATIC_ALLOC_BUDDY_ORDERS - 1 && static_alloc_buddy_is_free(arena, first ^ (1U << order), order)) {
+    static_alloc_buddy_remove(arena, first ^ (1U << order));
+    first &= ~(1U << order);
+    order++;
+  }
+  static_alloc_buddy_push(arena, first, order);
+}
+
+// In place resize: shrink releases upper halves, grow takes free buddies
+// (only when item is the lower one)
+static bool static_alloc_backend_resize(struct static_alloc_arena* arena, uint32_t first, uint32_t blocks, uint32_t required)
+{
+  if (required < blocks) {
+    while (blocks > required) {
+      blocks >>= 1;
+      static_alloc_backend_free(arena, first + blocks, blocks);
+    }
+    return true;
+  }
+  for (uint32_t size = blocks; size < required; size <<= 1) {
+    if ((first & size) || !static_alloc_buddy_is_free(arena, first + size, static_alloc_buddy_order(size))) {
+      return false;
+    }
+  }
+  for (uint32_t size = blocks; size < required; size <<= 1) {
+    static_alloc_buddy_remove(arena, first + size);
+  }
+
+  return true;
+}
+
+static uint32_t static_alloc_backend_free_blocks(struct static_alloc_arena* arena)
+{
+  return arena->buddy_free_blocks;
+}
+
+// The largest chunk: buddy allocator can't use free space across chunks
+static uint32_t static_alloc_largest_free(struct static_alloc_arena* arena)
+{
+  for (uint32_t k = STATIC_ALLOC_BUDDY_ORDERS; k > 0; k--) {
+    if (arena->buddy_free[k - 1]) {
+      return 1U << (k - 1);
+    }
+  }
+  return 0;
+}
+#endif
+
+#ifdef STATIC_ALLOC_STATS
+// Memory taken by item, block granularity
+static uint32_t static_alloc_item_bytes(struct static_alloc_arena* arena, struct static_alloc_item* item)
 {
-  if (buf_size > 32000) {
-    // At most 512 blocks may fit into metadata. don't use more memory
-    buf_size = 31744;
+  uint32_t blocks = item->blocks_used;
+
+  if (blocks & ITEM_CLASS_FLAG) {
+    uint32_t size = arena->classes[blocks & ~ITEM_CLASS_FLAG].size;
+    blocks = static_alloc_backend_blocks(BLOCKS_FOR(size < sizeof(void*) ? sizeof(void*) : size));
+  }
+  return blocks * STATIC_ALLOC_BLOCK_SIZE;
+}
+
+// Histogram bucket: up to 16 bytes, up to 32 bytes, ...
+static inline uint32_t static_alloc_stats_bucket(uint32_t size)
+{
+  uint32_t bucket = size <= 16 ? 0 : 28 - __builtin_clz(size - 1);
+
+  return bucket < STATIC_ALLOC_STATS_BUCKETS ? bucket : STATIC_ALLOC_STATS_BUCKETS - 1;
+}
+
+// Stats are updated in critical section: allocations are made from
+// interrupts as well
+static void static_alloc_stats_alloc(struct static_alloc_arena* arena, uint32_t size, shared_void* ptr)
+{
+  struct static_alloc_stats* stats = &arena->stats;
+  uint32_t bucket = static_alloc_stats_bucket(size);
+  uint32_t bytes = 0;
+
+  if (ptr) {
+    bytes = static_alloc_item_bytes(arena, (struct static_alloc_item*)((uint8_t*)ptr - sizeof(struct static_alloc_item)));
+  }
+
+  uint32_t state = static_alloc_critical_enter();
+  if (ptr) {
+    stats->allocs++;
+    stats->sizes[bucket]++;
+    stats->bytes_used += bytes;
+    if (stats->bytes_used > stats->bytes_peak) {
+      stats->bytes_peak = stats->bytes_used;
+    }
+  } else {
+    stats->failures++;
+    stats->failed_sizes[bucket]++;
+  }
+  static_alloc_critical_exit(state);
+}
+
+static void static_alloc_stats_used(struct static_alloc_arena* arena, uint32_t released, uint32_t taken)
+{
+  struct static_alloc_stats* stats = &arena->stats;
+
+  uint32_t state = static_alloc_critical_enter();
+  stats->bytes_used = stats->bytes_used - released + taken;
+  if (stats->bytes_used > stats->bytes_peak) {
+    stats->bytes_peak = stats->bytes_used;
   }
+  static_alloc_critical_exit(state);
+}
+
+// Called with allocator lock held: "end" is offset of item end from the
+// first user block
+static inline void static_alloc_stats_high_water(struct static_alloc_arena* arena, uint32_t end)
+{
+  if (end > arena->stats.high_water) {
+    arena->stats.high_water = end;
+  }
+}
+#else
+#define static_alloc_stats_alloc(...)
+#define static_alloc_stats_used(...)
+#define static_alloc_stats_high_water(...)
+#endif
+
+// Takes item from the smallest size class which fits "size".
+// Interrupt safe: list is accessed in critical section only.
+static shared_void* static_alloc_class_alloc(struct static_alloc_arena* arena, uint32_t size)
+{
+  for (uint32_t i = 0; i < arena->classes_count; i++) {
+    struct static_alloc_class* cls = &arena->classes[i];
+    if (size > cls->size) {
+      continue;
+    }
+    uint32_t state = static_alloc_critical_enter();
+    shared_void* ptr = cls->free_list;
+    if (ptr) {
+      cls->hits++;
+      // Next free item pointer is stored in user data of free item
+      memcpy(&cls->free_list, ptr, sizeof(void*));
+    } else {
+      cls->misses++;
+    }
+    static_alloc_critical_exit(state);
+    if (ptr) {
+      ((struct static_alloc_item*)((uint8_t*)ptr - sizeof(struct static_alloc_item)))->refcount = 1;
+    }
+    return ptr;
+  }
+
+  return NULL;
+}
+
+// Returns size class item into its free list. Interrupt safe.
+static void static_alloc_class_free(struct static_alloc_arena* arena, struct static_alloc_item* item)
+{
+  struct static_alloc_class* cls = &arena->classes[item->blocks_used & ~ITEM_CLASS_FLAG];
+  shared_void* ptr = (uint8_t*)item + sizeof(struct static_alloc_item);
+
+  uint32_t state = static_alloc_critical_enter();
+  memcpy(ptr, &cls->free_list, sizeof(void*));
+  cls->free_list = ptr;
+  static_alloc_critical_exit(state);
+}
+
+void static_alloc_arena_init(struct static_alloc_arena* arena, uint8_t* buf, uint32_t buf_size)
+{
   memset(buf, 0, buf_size);
   uint32_t max_possible_blocks = buf_size / STATIC_ALLOC_BLOCK_SIZE;
-  // First block reserved for metadata
-  _blocks_status = (uint32_t*)buf;
-  _blocks_count = max_possible_blocks - 1;
-  // User blocks located right after block statuses
-  _blocks_user_data = buf + STATIC_ALLOC_BLOCK_SIZE;
-  // Init block status: all free
-  for (uint32_t i = 0; i < _blocks_count; i++) {
-    MARK_BLOCK_AS_FREE(i);
+  if (max_possible_blocks > MAX_BLOCKS) {
+    // blocks_used of item header is limited. don't use more memory
+    max_possible_blocks = MAX_BLOCKS;
   }
+  // First blocks reserved for metadata (status bitmap), as many as needed
+  // to describe the rest of blocks
+  uint32_t meta_blocks = 1;
+  while (meta_blocks < max_possible_blocks &&
+         meta_blocks * STATIC_ALLOC_BLOCK_SIZE * 8 < max_possible_blocks - meta_blocks) {
+    meta_blocks++;
+  }
+  arena->blocks_status = (uint32_t*)buf;
+  // Pool too small to hold metadata and at least one user block: empty arena,
+  // every allocation fails
+  arena->blocks_count = max_possible_blocks > meta_blocks ? max_possible_blocks - meta_blocks : 0;
+  // User blocks located right after block statuses
+  arena->blocks_user_data = buf + meta_blocks * STATIC_ALLOC_BLOCK_SIZE;
+  arena->classes = NULL;
+  arena->classes_count = 0;
+  arena->policy = STATIC_ALLOC_FIRST_FIT;
+  arena->rover = 0;
+  memset(&arena->stats, 0, sizeof(arena->stats));
+  static_alloc_backend_init(arena);
   // Create mutex if RTOS enabled
 #ifdef STATIC_ALLOC_FREERTOS
-  _mutex = xSemaphoreCreateMutexStatic(&_mutex_buffer);
+  arena->mutex = xSemaphoreCreateMutexStatic(&arena->mutex_buffer);
 #endif
 }
 
-shared_void* static_alloc_alloc(uint32_t size)
+// Allocation of regular item, placement according to arena policy / flags
+static shared_void* static_alloc_blocks_alloc(struct static_alloc_arena* arena, uint32_t blocks_required, uint32_t flags)
 {
-  uint32_t total_size = size + sizeof(struct static_alloc_item);
-  uint32_t blocks_required = (total_size + STATIC_ALLOC_BLOCK_SIZE - 1) / STATIC_ALLOC_BLOCK_SIZE;
-  uint32_t blocks_found = 0;
-  void*    result = NULL;
+  void* result = NULL;
 
+  blocks_required = static_alloc_backend_blocks(blocks_required);
   // FreeRTOS requires critical section in order to be task safe
 #ifdef STATIC_ALLOC_FREERTOS
-  if (xSemaphoreTake(_mutex, portMAX_DELAY) != pdTRUE) {
+  if (xSemaphoreTake(arena->mutex, portMAX_DELAY) != pdTRUE) {
     return NULL;
   }
 #endif
-  // Find first free block
-  // TODO: this could be improved by using __buildin_* functions to
-  // count bits, however it will complicate the code.
-  for (uint32_t i = 0; i < _blocks_count; i++) {
-    if (IS_BLOCK_FREE(i)) {
-      blocks_found++;
-    } else {
-      blocks_found = 0;
-    }
-    if (blocks_found == blocks_required) {
-      uint32_t first_block = (i - blocks_required + 1);
-      uint32_t offset = first_block * STATIC_ALLOC_BLOCK_SIZE;
-      // Mark all these blocks as used
-      for (uint32_t j = first_block; j <= i; j++) {
-        MARK_BLOCK_AS_USED(j);
-      }
-      // Setup metadata and return pointer next to metadata
-      struct static_alloc_item* item = (struct static_alloc_item*)(_blocks_user_data + offset);
-      item->blocks_used = blocks_required;
-      item->refcount = 1;
-      result = ((uint8_t*)item + sizeof(struct static_alloc_item));
-      break;
-    }
+  int32_t first_block = static_alloc_backend_alloc(arena, blocks_required, flags);
+  if (first_block >= 0) {
+    uint32_t offset = first_block * STATIC_ALLOC_BLOCK_SIZE;
+    // Setup metadata and return pointer next to metadata
+    struct static_alloc_item* item = (struct static_alloc_item*)(arena->blocks_user_data + offset);
+    item->blocks_used = blocks_required;
+    item->refcount = 1;
+    result = ((uint8_t*)item + sizeof(struct static_alloc_item));
+    static_alloc_stats_high_water(arena, (first_block + blocks_required) * STATIC_ALLOC_BLOCK_SIZE);
   }
   // Out of memory: unable to find continuos array of N blocks
 
   // Release mutex for RTOS version
 #ifdef STATIC_ALLOC_FREERTOS
-  xSemaphoreGive(_mutex);
+  xSemaphoreGive(arena->mutex);
 #endif
   return result;
 }
 
+shared_void* static_alloc_arena_alloc_ex(struct static_alloc_arena* arena, uint32_t size, uint32_t flags)
+{
+  shared_void* result = NULL;
+
+  // Size class pools first (they are for short lived items), then blocks
+  if (!(flags & STATIC_ALLOC_LONG_LIVED)) {
+    result = static_alloc_class_alloc(arena, size);
+  }
+  if (result == NULL && size <= MAX_ITEM_SIZE) {
+    result = static_alloc_blocks_alloc(arena, BLOCKS_FOR(size), flags);
+  }
+  static_alloc_stats_alloc(arena, size, result);
+  STATIC_ALLOC_TRACE_EVENT(arena, STATIC_ALLOC_TRACE_ALLOC, flags, result, size);
+
+  return result;
+}
+
+shared_void* static_alloc_arena_alloc(struct static_alloc_arena* arena, uint32_t size)
+{
+  return static_alloc_arena_alloc_ex(arena, size, 0);
+}
+
+void static_alloc_arena_set_policy(struct static_alloc_arena* arena, enum static_alloc_policy policy)
+{
+  arena->policy = policy;
+  arena->rover = 0;
+}
+
+shared_void* static_alloc_arena_alloc_isr(struct static_alloc_arena* arena, uint32_t size)
+{
+  shared_void* result = static_alloc_class_alloc(arena, size);
+
+  static_alloc_stats_alloc(arena, size, result);
+  STATIC_ALLOC_TRACE_EVENT(arena, STATIC_ALLOC_TRACE_ALLOC, STATIC_ALLOC_TRACE_ISR, result, size);
+
+  return result;
+}
+
 shared_void* static_alloc_copy(shared_void* ptr)
 {
   struct static_alloc_item* item = (struct static_alloc_item*)((uint8_t*)ptr - sizeof(struct static_alloc_item));
-  item->refcount++;
+  static_alloc_ref_inc(item);
+  STATIC_ALLOC_TRACE_EVENT(&_default_arena, STATIC_ALLOC_TRACE_COPY, 0, ptr, 0);
 
   return ptr;
 }
 
-void static_alloc_free(shared_void* ptr)
+bool static_alloc_unref(shared_void* ptr)
 {
   struct static_alloc_item* item = (struct static_alloc_item*)((uint8_t*)ptr - sizeof(struct static_alloc_item));
 
+  if (static_alloc_ref_drop(item)) {
+    return true;
+  }
+  // Same as free of not the last reference
+  STATIC_ALLOC_TRACE_EVENT(&_default_arena, STATIC_ALLOC_TRACE_FREE, 0, ptr, 0);
+
+  return false;
+}
+
+void static_alloc_arena_free(struct static_alloc_arena* arena, shared_void* ptr)
+{
+  struct static_alloc_item* item = (struct static_alloc_item*)((uint8_t*)ptr - sizeof(struct static_alloc_item));
+
+  STATIC_ALLOC_TRACE_EVENT(arena, STATIC_ALLOC_TRACE_FREE, 0, ptr, 0);
+  // Dec ref count, nothing else to do while somebody else uses this memory
+  if (!static_alloc_ref_dec(item)) {
+    return;
+  }
+
+  // Nobody else using this memory. Size class item: back to class free
+  // list, no allocator lock needed
+  static_alloc_stats_used(arena, static_alloc_item_bytes(arena, item), 0);
+  if (item->blocks_used & ITEM_CLASS_FLAG) {
+    static_alloc_class_free(arena, item);
+    return;
+  }
+
   // FreeRTOS requires critical section in order to be task safe
 #ifdef STATIC_ALLOC_FREERTOS
-  xSemaphoreTake(_mutex, portMAX_DELAY);
+  xSemaphoreTake(arena->mutex, portMAX_DELAY);
 #endif
 
-  // Dec ref count
-  if (item->refcount > 0) {
-    item->refcount--;
-  }
-  // If nobody else using this memory - mark it as free
-  if (item->refcount == 0) {
-    // Find first block index
-    uint32_t index = ((uint8_t*)item - _blocks_user_data) / STATIC_ALLOC_BLOCK_SIZE;
-    // Mark all allocated blocks as free
-    for (uint32_t i = index; i < index + item->blocks_used; i++) {
-      MARK_BLOCK_AS_FREE(i);
-    }
-  }
+  // Find first block index
+  uint32_t index = ((uint8_t*)item - arena->blocks_user_data) / STATIC_ALLOC_BLOCK_SIZE;
+  static_alloc_backend_free(arena, index, item->blocks_used);
 
   // Release mutex for RTOS version
 #ifdef STATIC_ALLOC_FREERTOS
-  xSemaphoreGive(_mutex);
+  xSemaphoreGive(arena->mutex);
 #endif
 }
 
-uint32_t static_alloc_info_mem_free(void)
+// Resizes regular item in place. Returns false if there is no room after item.
+static bool static_alloc_resize(struct static_alloc_arena* arena, struct static_alloc_item* item, uint32_t blocks_required)
 {
-  uint32_t free = 0;
+  uint32_t index = ((uint8_t*)item - arena->blocks_user_data) / STATIC_ALLOC_BLOCK_SIZE;
+  uint32_t blocks_used = item->blocks_used;
+
+  blocks_required = static_alloc_backend_blocks(blocks_required);
+#ifdef STATIC_ALLOC_FREERTOS
+  xSemaphoreTake(arena->mutex, portMAX_DELAY);
+#endif
+  bool res = static_alloc_backend_resize(arena, index, blocks_used, blocks_required);
+  if (res) {
+    item->blocks_used = blocks_required;
+    static_alloc_stats_high_water(arena, (index + blocks_required) * STATIC_ALLOC_BLOCK_SIZE);
+  }
+#ifdef STATIC_ALLOC_FREERTOS
+  xSemaphoreGive(arena->mutex);
+#endif
+  if (res) {
+    static_alloc_stats_used(arena, blocks_used * STATIC_ALLOC_BLOCK_SIZE, blocks_required * STATIC_ALLOC_BLOCK_SIZE);
+  }
 
-  for (uint32_t i = 0; i < _blocks_count; i++) {
-    if (IS_BLOCK_FREE(i)) {
-      free += STATIC_ALLOC_BLOCK_SIZE;
+  return res;
+}
+
+shared_void* static_alloc_arena_realloc(struct static_alloc_arena* arena, shared_void* ptr, uint32_t size)
+{
+  if (ptr == NULL) {
+    return static_alloc_arena_alloc(arena, size);
+  }
+
+  struct static_alloc_item* item = (struct static_alloc_item*)((uint8_t*)ptr - sizeof(struct static_alloc_item));
+  uint32_t capacity;
+
+  if (item->blocks_used & ITEM_CLASS_FLAG) {
+    // Size class item: fixed size
+    capacity = arena->classes[item->blocks_used & ~ITEM_CLASS_FLAG].size;
+    if (size <= capacity) {
+      STATIC_ALLOC_TRACE_EVENT(arena, STATIC_ALLOC_TRACE_REALLOC, 0, ptr, size);
+      return ptr;
+    }
+  } else {
+    if (size > MAX_ITEM_SIZE) {
+      return NULL;
+    }
+    uint32_t blocks_required = BLOCKS_FOR(size);
+    if (item->refcount != 1 && blocks_required < item->blocks_used) {
+      // Shared item is not shrunk: other owners still use its whole size
+      return ptr;
     }
+    if (static_alloc_resize(arena, item, blocks_required)) {
+      STATIC_ALLOC_TRACE_EVENT(arena, STATIC_ALLOC_TRACE_REALLOC, 0, ptr, size);
+      return ptr;
+    }
+    capacity = item->blocks_used * STATIC_ALLOC_BLOCK_SIZE - sizeof(struct static_alloc_item);
   }
-  return free;
+
+  // Last resort: move. Not possible while item is shared - other owners
+  // would keep pointer to released memory.
+  if (item->refcount != 1) {
+    return NULL;
+  }
+  shared_void* result = static_alloc_arena_alloc(arena, size);
+  if (result == NULL) {
+    return NULL;
+  }
+  memcpy(result, ptr, capacity < size ? capacity : size);
+  static_alloc_arena_free(arena, ptr);
+
+  return result;
+}
+
+bool static_alloc_arena_init_classes(struct static_alloc_arena* arena,
+                                     struct static_alloc_class* classes, uint32_t count)
+{
+  bool res = true;
+
+  // Allocate class items while classes are not enabled yet
+  for (uint32_t c = 0; c < count; c++) {
+    struct static_alloc_class* cls = &classes[c];
+    cls->free_list = NULL;
+    cls->hits = 0;
+    cls->misses = 0;
+    for (uint32_t i = 0; i < cls->count; i++) {
+      // Class items are not accounted in stats until taken from free list
+      shared_void* ptr = static_alloc_blocks_alloc(arena, BLOCKS_FOR(cls->size < sizeof(void*) ? sizeof(void*) : cls->size), 0);
+      if (ptr == NULL) {
+        res = false;
+        break;
+      }
+      struct static_alloc_item* item = (struct static_alloc_item*)((uint8_t*)ptr - sizeof(struct static_alloc_item));
+      item->blocks_used = ITEM_CLASS_FLAG | c;
+      item->refcount = 0;
+      memcpy(ptr, &cls->free_list, sizeof(void*));
+      cls->free_list = ptr;
+    }
+  }
+  arena->classes = classes;
+  arena->classes_count = count;
+
+  return res;
+}
+
+uint32_t static_alloc_arena_info_mem_free(struct static_alloc_arena* arena)
+{
+  return static_alloc_backend_free_blocks(arena) * STATIC_ALLOC_BLOCK_SIZE;
+}
+
+void static_alloc_arena_stats(struct static_alloc_arena* arena, struct static_alloc_stats* stats)
+{
+  uint32_t state = static_alloc_critical_enter();
+  *stats = arena->stats;
+  static_alloc_critical_exit(state);
+
+#ifdef STATIC_ALLOC_FREERTOS
+  xSemaphoreTake(arena->mutex, portMAX_DELAY);
+#endif
+  stats->bytes_free = static_alloc_arena_info_mem_free(arena);
+  stats->largest_free = static_alloc_largest_free(arena) * STATIC_ALLOC_BLOCK_SIZE;
+#ifdef STATIC_ALLOC_FREERTOS
+  xSemaphoreGive(arena->mutex);
+#endif
+}
+
+// Default arena //
+void static_alloc_init(uint8_t* buf, uint32_t buf_size)
+{
+  static_alloc_arena_init(&_default_arena, buf, buf_size);
+}
+
+shared_void* static_alloc_alloc(uint32_t size)
+{
+  return static_alloc_arena_alloc(&_default_arena, size);
+}
+
+shared_void* static_alloc_alloc_ex(uint32_t size, uint32_t flags)
+{
+  return static_alloc_arena_alloc_ex(&_default_arena, size, flags);
+}
+
+void static_alloc_set_policy(enum static_alloc_policy policy)
+{
+  static_alloc_arena_set_policy(&_default_arena, policy);
+}
+
+shared_void* static_alloc_alloc_isr(uint32_t size)
+{
+  return static_alloc_arena_alloc_isr(&_default_arena, size);
+}
+
+void static_alloc_stats(struct static_alloc_stats* stats)
+{
+  static_alloc_arena_stats(&_default_arena, stats);
+}
+
+shared_void* static_alloc_realloc(shared_void* ptr, uint32_t size)
+{
+  return static_alloc_arena_realloc(&_default_arena, ptr, size);
+}
+
+void static_alloc_free(shared_void* ptr)
+{
+  static_alloc_arena_free(&_default_arena, ptr);
+}
+
+bool static_alloc_init_classes(struct static_alloc_class* classes, uint32_t count)
+{
+  return static_alloc_arena_init_classes(&_default_arena, classes, count);
+}
+
+uint32_t static_alloc_info_mem_free(void)
+{
+  return static_alloc_arena_info_mem_free(&_default_arena);
 }
 
 // unittests //
+#ifndef STATIC_ALLOC_BUDDY
 EXPORT uint32_t unittest_is_block_used(uint32_t block)
 {
-  return !IS_BLOCK_FREE(block);
+  return !IS_BLOCK_FREE(&_default_arena, block);
 }
 
 EXPORT uint32_t unittest_is_block_free(uint32_t block)
 {
-  return IS_BLOCK_FREE(block);
+  return IS_BLOCK_FREE(&_default_arena, block);
 }
+#endif
 
 EXPORT uint32_t unittest_blocks_count()
 {
-  return _blocks_count;
+  return _default_arena.blocks_count;
 }
 
 EXPORT uint8_t* unittest_user_data_starts_at()
 {
-  return _blocks_user_data;
-}
\ No newline at end of file
+  return _default_arena.blocks_user_data;
+}
@@ -5,24 +5,206 @@
 #define STATIC_ALLOCATOR_H
 
 #include <stdint.h>
+#include <stdbool.h>
 
 #ifndef STATIC_ALLOC_BLOCK_SIZE
 #define STATIC_ALLOC_BLOCK_SIZE      64
 #endif
 
+// Number of allocation size histogram buckets
+#ifndef STATIC_ALLOC_STATS_BUCKETS
+#define STATIC_ALLOC_STATS_BUCKETS   8
+#endif
+
+// Compile time option STATIC_ALLOC_BUDDY: buddy allocator instead of block
+// bitmap. Items take power of two number of blocks, alloc / free are
+// O(orders) list operations with coalescing (no bitmap scan) at the cost of
+// internal fragmentation. Placement policy / STATIC_ALLOC_LONG_LIVED are
+// ignored. Max chunk is (1 << (STATIC_ALLOC_BUDDY_ORDERS - 1)) blocks.
+#ifndef STATIC_ALLOC_BUDDY_ORDERS
+#define STATIC_ALLOC_BUDDY_ORDERS    16
+#endif
+
 #ifdef __cplusplus
 #define EXPORT extern "C"
 #else
 #define EXPORT
 #endif
 
+#ifdef STATIC_ALLOC_FREERTOS
+#include "FreeRTOS.h"
+#include "semphr.h"
+#endif
+
 typedef void shared_void;
 
+// Size class: dedicated pool of "count" items of up to "size" bytes,
+// kept in intrusive free list - constant time alloc / free.
+// Allocation is served from the smallest class which fits requested size,
+// when its pool is exhausted (miss) regular block allocator is used.
+struct static_alloc_class {
+  uint32_t size;
+  uint32_t count;
+  // Runtime state / stats
+  void*    free_list;
+  uint32_t hits;
+  uint32_t misses;
+};
+
+// Placement policy of regular (not size class) items
+enum static_alloc_policy {
+  // Lowest free run which fits (default)
+  STATIC_ALLOC_FIRST_FIT = 0,
+  // First fit starting from the end of previous allocation (roving pointer,
+  // status word granularity): spreads allocations over pool, so scan does
+  // not walk over long lived items at the beginning of pool every time
+  STATIC_ALLOC_NEXT_FIT,
+  // Smallest free run which fits: whole bitmap scan, keeps large runs intact
+  STATIC_ALLOC_BEST_FIT,
+};
+
+// static_alloc_alloc_ex() flags.
+// Hint that item is going to live (almost) forever: placed at the top of
+// pool (end of the last fitting free run), so it does not split free space
+// used by short lived items. Size classes are bypassed.
+#define STATIC_ALLOC_LONG_LIVED      0x01
+
+// Allocation statistics. Counters are maintained on every alloc / free (in
+// critical section) only with compile time option STATIC_ALLOC_STATS,
+// otherwise they stay zero and alloc / free pay nothing for them.
+// Snapshot part (bytes_free / largest_free) is always available.
+// Bytes are in block granularity.
+// Histogram bucket i counts requests of up to (16 << i) bytes, the last one
+// counts all larger requests as well.
+struct static_alloc_stats {
+  uint32_t allocs;
+  uint32_t failures;
+  uint32_t bytes_used;       // Taken by live items
+  uint32_t bytes_peak;
+  // End of the highest block ever used, offset from the first user block
+  // (pool start plus metadata blocks)
+  uint32_t high_water;
+  uint32_t sizes[STATIC_ALLOC_STATS_BUCKETS];
+  uint32_t failed_sizes[STATIC_ALLOC_STATS_BUCKETS];
+  // Snapshot only (see static_alloc_stats()): computed from block bitmap.
+  // Free memory much larger than largest free run means fragmentation.
+  uint32_t bytes_free;
+  uint32_t largest_free;     // Longest run of free blocks
+};
+
+// Allocation trace event (see static_alloc_trace_start()), 12 bytes.
+// Items are identified by index of their first block.
+#define STATIC_ALLOC_TRACE_ALLOC     1
+#define STATIC_ALLOC_TRACE_COPY      2
+#define STATIC_ALLOC_TRACE_FREE      3
+// Resized in place. Moved item is recorded as ALLOC of new + FREE of old one.
+#define STATIC_ALLOC_TRACE_REALLOC   4
+// Flags: static_alloc_alloc_ex() flags and STATIC_ALLOC_TRACE_ISR for
+// allocations made from interrupt (static_alloc_alloc_isr())
+#define STATIC_ALLOC_TRACE_ISR       0x80
+// Block of failed allocation
+#define STATIC_ALLOC_TRACE_NO_BLOCK  0xFFFF
+
+struct static_alloc_trace_event {
+  uint32_t timestamp;
+  uint32_t size;             // Requested size: alloc / realloc
+  uint16_t block;
+  uint8_t  op;
+  uint8_t  flags;
+};
+
+// Independent allocator instance: own memory pool (e.g. CCM RAM and DMA capable
+// SRAM may be managed separately) and own lock.
+struct static_alloc_arena {
+  uint32_t* blocks_status;
+  uint8_t*  blocks_user_data;
+  uint32_t  blocks_count;
+  struct static_alloc_class* classes;
+  uint32_t  classes_count;
+  struct static_alloc_stats stats;
+  enum static_alloc_policy policy;
+  uint32_t  rover;           // Next fit: status word to start search from
+#ifdef STATIC_ALLOC_BUDDY
+  void*     buddy_free[STATIC_ALLOC_BUDDY_ORDERS];  // Free chunks of each order
+  uint32_t  buddy_free_blocks;
+#endif
+#ifdef STATIC_ALLOC_FREERTOS
+  SemaphoreHandle_t  mutex;
+  StaticSemaphore_t  mutex_buffer;
+#endif
+};
+
+// Default arena
 EXPORT void         static_alloc_init(uint8_t* buf, uint32_t buf_size);
 EXPORT shared_void* static_alloc_alloc(uint32_t size);
+EXPORT shared_void* static_alloc_alloc_ex(uint32_t size, uint32_t flags);
 EXPORT shared_void* static_alloc_copy(shared_void* ptr);
 EXPORT void         static_alloc_free(shared_void* ptr);
+// Releases reference of shared item unless it is the last one (works for
+// items of any arena). Returns true when caller holds the last reference:
+// item is left allocated (e.g. to run destructor of object stored in it),
+// caller releases it by static_alloc_free() / static_alloc_arena_free().
+EXPORT bool         static_alloc_unref(shared_void* ptr);
+// Resizes item, keeps its content (up to the smaller of old / new sizes).
+// Grows in place when blocks right after item are free, shrinks by releasing
+// trailing blocks, data is moved into new item only as the last resort.
+// Shared item (see static_alloc_copy()) is never moved nor shrunk - other
+// owners rely on its size, so shrink request returns "ptr" unchanged (item
+// keeps its old size). Returns new pointer, or NULL (old one is still valid)
+// when there is not enough memory.
+// NULL "ptr" is the same as static_alloc_alloc().
+EXPORT shared_void* static_alloc_realloc(shared_void* ptr, uint32_t size);
 
 EXPORT uint32_t static_alloc_info_mem_free(void);
 
+// Placement policy, first fit by default. May be changed any time.
+EXPORT void static_alloc_set_policy(enum static_alloc_policy policy);
+
+// Optional size classes. "classes" must be sorted by size and outlive
+// allocator. Class items are allocated upfront (they are not counted as
+// free memory anymore). Returns false if there is not enough memory.
+EXPORT bool static_alloc_init_classes(struct static_alloc_class* classes, uint32_t count);
+
+// Interrupt safe allocation: served from size classes only, never blocks and
+// never scans block bitmap - returns NULL when fitting class is exhausted.
+// Freeing size class items is interrupt safe as well, regular items must be
+// freed from task context.
+// Interrupts are disabled for one pass over configured classes plus free
+// list pop (and stats update with STATIC_ALLOC_STATS), i.e. bounded by
+// number of classes, not by pool size. Cortex-M cycle figures are pending:
+// "make bench_arm" prints them (SysTick cycles, run on target).
+EXPORT shared_void* static_alloc_alloc_isr(uint32_t size);
+
+// Stats snapshot. Walks block bitmap (free memory / largest free run),
+// so it is intended for periodic monitoring, not for hot paths.
+EXPORT void static_alloc_stats(struct static_alloc_stats* stats);
+
+#ifdef STATIC_ALLOC_TRACE
+#include "ring_buffer.h"
+// Compile time option STATIC_ALLOC_TRACE: every alloc / copy / realloc /
+// free of default arena is recorded into "ring" as
+// struct static_alloc_trace_event. Events which do not fit into ring are
+// dropped (ring "dropped" counter). NULL stops recording.
+// Timestamp source is STATIC_ALLOC_TRACE_TIMESTAMP() macro, e.g.
+//   -D'STATIC_ALLOC_TRACE_TIMESTAMP()=HAL_GetTick()'
+// Recorded trace can be replayed on host by test/static_alloc_replay.c
+EXPORT void static_alloc_trace_start(struct ring_buffer* ring);
+#endif
+
+// Arena API. Item must be released into the arena it was allocated from.
+// static_alloc_copy() works for items of any arena.
+EXPORT void         static_alloc_arena_init(struct static_alloc_arena* arena, uint8_t* buf, uint32_t buf_size);
+EXPORT shared_void* static_alloc_arena_alloc(struct static_alloc_arena* arena, uint32_t size);
+EXPORT shared_void* static_alloc_arena_alloc_ex(struct static_alloc_arena* arena, uint32_t size, uint32_t flags);
+EXPORT void         static_alloc_arena_free(struct static_alloc_arena* arena, shared_void* ptr);
+EXPORT shared_void* static_alloc_arena_realloc(struct static_alloc_arena* arena, shared_void* ptr, uint32_t size);
+EXPORT shared_void* static_alloc_arena_alloc_isr(struct static_alloc_arena* arena, uint32_t size);
+
+EXPORT bool         static_alloc_arena_init_classes(struct static_alloc_arena* arena,
+                                                    struct static_alloc_class* classes, uint32_t count);
+
+EXPORT uint32_t static_alloc_arena_info_mem_free(struct static_alloc_arena* arena);
+EXPORT void     static_alloc_arena_set_policy(struct static_alloc_arena* arena, enum static_alloc_policy policy);
+EXPORT void     static_alloc_arena_stats(struct static_alloc_arena* arena, struct static_alloc_stats* stats);
+
 #endif
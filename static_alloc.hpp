@@ -0,0 +1,136 @@
+// Copyright (c) Konstantin Belyalov. All rights reserved.
+// Licensed under the MIT license.
+//
+// C++ ownership helpers over static_alloc (default arena). Header only,
+// no heap, C++11.
+//  - static_shared_ptr<T>: RAII handle of shared item. Copy takes reference
+//    (static_alloc_copy()), move just transfers it (no refcount traffic),
+//    the last owner destroys object and releases memory.
+//  - static_allocator<T>: standard allocator, so containers may use pool.
+
+#ifndef __STATIC_ALLOC_HPP
+#define __STATIC_ALLOC_HPP
+
+#include <stddef.h>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include "static_alloc.h"
+
+namespace static_alloc_detail {
+
+// User data follows 4 bytes item header
+static const size_t alignment = 4;
+
+}  // namespace static_alloc_detail
+
+template <typename T>
+class static_shared_ptr {
+  static_assert(alignof(T) <= static_alloc_detail::alignment,
+                "static_alloc items are only 4 bytes aligned");
+
+ public:
+  typedef T element_type;
+
+  static_shared_ptr() noexcept : ptr_(nullptr) {}
+  static_shared_ptr(std::nullptr_t) noexcept : ptr_(nullptr) {}
+  static_shared_ptr(const static_shared_ptr& other) noexcept : ptr_(other.ptr_) {
+    if (ptr_) {
+      static_alloc_copy(ptr_);
+    }
+  }
+  static_shared_ptr(static_shared_ptr&& other) noexcept : ptr_(other.ptr_) { other.ptr_ = nullptr; }
+  ~static_shared_ptr() { reset(); }
+
+  static_shared_ptr& operator=(const static_shared_ptr& other) noexcept {
+    static_shared_ptr(other).swap(*this);
+    return *this;
+  }
+  static_shared_ptr& operator=(static_shared_ptr&& other) noexcept {
+    static_shared_ptr(std::move(other)).swap(*this);
+    return *this;
+  }
+
+  // Creates object in newly allocated item. Empty pointer when out of memory.
+  template <typename... Args>
+  static static_shared_ptr make(Args&&... args) {
+    static_shared_ptr res;
+    void* mem = static_alloc_alloc(sizeof(T));
+    if (mem) {
+      res.ptr_ = new (mem) T(std::forward<Args>(args)...);
+    }
+    return res;
+  }
+
+  void reset() noexcept {
+    if (ptr_ == nullptr) {
+      return;
+    }
+    if (std::is_trivially_destructible<T>::value) {
+      static_alloc_free(ptr_);
+    } else if (static_alloc_unref(ptr_)) {
+      // The last owner
+      ptr_->~T();
+      static_alloc_free(ptr_);
+    }
+    ptr_ = nullptr;
+  }
+
+  void swap(static_shared_ptr& other) noexcept { std::swap(ptr_, other.ptr_); }
+
+  T* get() const noexcept { return ptr_; }
+  T& operator*() const noexcept { return *ptr_; }
+  T* operator->() const noexcept { return ptr_; }
+  explicit operator bool() const noexcept { return ptr_ != nullptr; }
+
+  bool operator==(const static_shared_ptr& other) const noexcept { return ptr_ == other.ptr_; }
+  bool operator!=(const static_shared_ptr& other) const noexcept { return ptr_ != other.ptr_; }
+
+ private:
+  T* ptr_;
+};
+
+template <typename T, typename... Args>
+static_shared_ptr<T> make_static_shared(Args&&... args)
+{
+  return static_shared_ptr<T>::make(std::forward<Args>(args)...);
+}
+
+// Allocation failure throws std::bad_alloc when exceptions are enabled,
+// otherwise (typical firmware build) returns nullptr - containers do not
+// expect that, so pool must be sized for worst case.
+// NOTE: containers which grow geometrically (std::vector) need reserve()
+// upfront to avoid pool fragmentation.
+template <typename T>
+class static_allocator {
+  static_assert(alignof(T) <= static_alloc_detail::alignment,
+                "static_alloc items are only 4 bytes aligned");
+
+ public:
+  typedef T value_type;
+
+  static_allocator() noexcept {}
+  template <typename U>
+  static_allocator(const static_allocator<U>&) noexcept {}
+
+  T* allocate(size_t n) {
+    void* mem = n * sizeof(T) <= UINT32_MAX ? static_alloc_alloc(n * sizeof(T)) : nullptr;
+#if defined(__cpp_exceptions) || defined(__EXCEPTIONS)
+    if (mem == nullptr) {
+      throw std::bad_alloc();
+    }
+#endif
+    return static_cast<T*>(mem);
+  }
+
+  void deallocate(T* ptr, size_t) noexcept { static_alloc_free(ptr); }
+};
+
+// Stateless: memory of any instance may be released by any other one
+template <typename T, typename U>
+bool operator==(const static_allocator<T>&, const static_allocator<U>&) noexcept { return true; }
+
+template <typename T, typename U>
+bool operator!=(const static_allocator<T>&, const static_allocator<U>&) noexcept { return false; }
+
+#endif
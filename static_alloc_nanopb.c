@@ -0,0 +1,69 @@
+// Copyright (c) Konstantin Belyalov. All rights reserved.
+// Licensed under the MIT license.
+
+#include "static_alloc_nanopb.h"
+
+// StaticAllocStats field numbers, see static_alloc.proto
+#define FIELD_ALLOCS        1
+#define FIELD_FAILURES      2
+#define FIELD_BYTES_USED    3
+#define FIELD_BYTES_PEAK    4
+#define FIELD_HIGH_WATER    5
+#define FIELD_SIZES         6
+#define FIELD_FAILED_SIZES  7
+#define FIELD_BYTES_FREE    8
+#define FIELD_LARGEST_FREE  9
+
+static bool pb_encode_stats_uint32(pb_ostream_t* stream, uint32_t field, uint32_t value)
+{
+  // proto3: default (zero) values are not encoded
+  if (value == 0) {
+    return true;
+  }
+  return pb_encode_tag(stream, PB_WT_VARINT, field) && pb_encode_varint(stream, value);
+}
+
+// Packed repeated field. All buckets are encoded (zeros as well), so
+// position in array is bucket index.
+static bool pb_encode_stats_packed(pb_ostream_t* stream, uint32_t field, const uint32_t* values, uint32_t count)
+{
+  pb_ostream_t sizing = PB_OSTREAM_SIZING;
+
+  for (uint32_t i = 0; i < count; i++) {
+    pb_encode_varint(&sizing, values[i]);
+  }
+  if (!pb_encode_tag(stream, PB_WT_STRING, field) || !pb_encode_varint(stream, sizing.bytes_written)) {
+    return false;
+  }
+  for (uint32_t i = 0; i < count; i++) {
+    if (!pb_encode_varint(stream, values[i])) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool pb_encode_static_alloc_stats(pb_ostream_t* stream, const struct static_alloc_stats* stats)
+{
+  return pb_encode_stats_uint32(stream, FIELD_ALLOCS, stats->allocs) &&
+         pb_encode_stats_uint32(stream, FIELD_FAILURES, stats->failures) &&
+         pb_encode_stats_uint32(stream, FIELD_BYTES_USED, stats->bytes_used) &&
+         pb_encode_stats_uint32(stream, FIELD_BYTES_PEAK, stats->bytes_peak) &&
+         pb_encode_stats_uint32(stream, FIELD_HIGH_WATER, stats->high_water) &&
+         pb_encode_stats_packed(stream, FIELD_SIZES, stats->sizes, STATIC_ALLOC_STATS_BUCKETS) &&
+         pb_encode_stats_packed(stream, FIELD_FAILED_SIZES, stats->failed_sizes, STATIC_ALLOC_STATS_BUCKETS) &&
+         pb_encode_stats_uint32(stream, FIELD_BYTES_FREE, stats->bytes_free) &&
+         pb_encode_stats_uint32(stream, FIELD_LARGEST_FREE, stats->largest_free);
+}
+
+bool pb_encode_static_alloc_stats_delimited(pb_ostream_t* stream, const struct static_alloc_stats* stats)
+{
+  pb_ostream_t sizing = PB_OSTREAM_SIZING;
+
+  if (!pb_encode_static_alloc_stats(&sizing, stats)) {
+    return false;
+  }
+
+  return pb_encode_varint(stream, sizing.bytes_written) && pb_encode_static_alloc_stats(stream, stats);
+}
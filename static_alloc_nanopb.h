@@ -0,0 +1,32 @@
+// Copyright (c) Konstantin Belyalov. All rights reserved.
+// Licensed under the MIT license.
+
+#ifndef __STATIC_ALLOC_NANOPB_H
+#define __STATIC_ALLOC_NANOPB_H
+
+#include <pb_encode.h>
+#include "static_alloc.h"
+
+#ifdef __cplusplus
+#define EXPORT extern "C"
+#else
+#define EXPORT
+#endif
+
+// Encoders of StaticAllocStats message (static_alloc.proto) for remote
+// monitoring. Hand written on top of nanopb low level API, so no generated
+// code / field descriptors are required.
+//
+// Plain message, e.g. for pb_ostream_from_buffer():
+//   struct static_alloc_stats stats;
+//   static_alloc_stats(&stats);
+//   pb_encode_static_alloc_stats(&stream, &stats);
+EXPORT bool pb_encode_static_alloc_stats(pb_ostream_t* stream, const struct static_alloc_stats* stats);
+
+// Length prefixed message: delimited message (e.g. ring_buffer record) or
+// submessage body, i.e. from encode callback of field of your own message:
+//   pb_encode_tag_for_field(stream, field) &&
+//   pb_encode_static_alloc_stats_delimited(stream, &stats);
+EXPORT bool pb_encode_static_alloc_stats_delimited(pb_ostream_t* stream, const struct static_alloc_stats* stats);
+
+#endif
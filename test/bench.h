@@ -0,0 +1,107 @@
+// Copyright (c) Konstantin Belyalov. All rights reserved.
+// Licensed under the MIT license.
+//
+// Tiny benchmark helpers, used by both host and ARM benchmark builds.
+
+#ifndef __BENCH_H
+#define __BENCH_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+#define EXPORT extern "C"
+#else
+#define EXPORT
+#endif
+
+#if defined(__arm__)
+// SysTick is present on every Cortex-M (including M0 which has no DWT cycle
+// counter). 24 bit down counter clocked from core clock.
+#define BENCH_SYST_CSR  (*(volatile uint32_t*)0xE000E010)
+#define BENCH_SYST_RVR  (*(volatile uint32_t*)0xE000E014)
+#define BENCH_SYST_CVR  (*(volatile uint32_t*)0xE000E018)
+
+static inline void bench_init(void)
+{
+  BENCH_SYST_RVR = 0x00FFFFFF;
+  BENCH_SYST_CVR = 0;
+  BENCH_SYST_CSR = 5;   // Enable, processor clock, no interrupt
+}
+
+// Counter is only 24 bit wide: measured intervals must be shorter than 2^24 cycles
+typedef uint32_t bench_cycles_t;
+
+static inline bench_cycles_t bench_cycles(void)
+{
+  return 0x00FFFFFF - BENCH_SYST_CVR;
+}
+
+static inline bench_cycles_t bench_elapsed(bench_cycles_t start)
+{
+  return (bench_cycles() - start) & 0x00FFFFFF;
+}
+
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+
+static inline void bench_init(void)
+{
+}
+
+// TSC ticks: close to core cycles on modern CPUs with invariant TSC
+typedef uint64_t bench_cycles_t;
+
+static inline bench_cycles_t bench_cycles(void)
+{
+  return __rdtsc();
+}
+
+static inline bench_cycles_t bench_elapsed(bench_cycles_t start)
+{
+  return __rdtsc() - start;
+}
+
+#else
+#include <time.h>
+
+static inline void bench_init(void)
+{
+}
+
+// Fallback: nanoseconds
+typedef uint64_t bench_cycles_t;
+
+static inline bench_cycles_t bench_cycles(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static inline bench_cycles_t bench_elapsed(bench_cycles_t start)
+{
+  return bench_cycles() - start;
+}
+#endif
+
+// Prevents compiler from optimizing away benchmark results
+#ifdef __cplusplus
+extern "C" volatile uint32_t bench_sink;
+#else
+extern volatile uint32_t bench_sink;
+#endif
+
+// Benchmarks, see bench_main.c
+EXPORT void bench_ring(void);
+EXPORT void bench_static_alloc(void);
+EXPORT void bench_ring_cpp(void);
+// Host only (nanopb)
+EXPORT void bench_ring_nanopb(void);
+
+static inline void bench_report(const char* name, uint64_t cycles, uint32_t ops)
+{
+  printf("%-48s %10.2f cycles/op\n", name, (double)cycles / ops);
+}
+
+#endif
@@ -0,0 +1,38 @@
+// Copyright (c) Konstantin Belyalov. All rights reserved.
+// Licensed under the MIT license.
+//
+// Benchmarks runner. Optional argument is substring of benchmark name to run.
+
+#include <string.h>
+#include "bench.h"
+
+volatile uint32_t bench_sink;
+
+struct bench {
+  const char* name;
+  void (*run)(void);
+};
+
+static const struct bench benches[] = {
+  {"ring", bench_ring},
+  {"static_alloc", bench_static_alloc},
+  {"ring_cpp", bench_ring_cpp},
+#ifndef __arm__
+  {"ring_nanopb", bench_ring_nanopb},
+#endif
+};
+
+int main(int argc, char** argv)
+{
+  bench_init();
+
+  for (size_t i = 0; i < sizeof(benches) / sizeof(benches[0]); i++) {
+    if (argc > 1 && strstr(benches[i].name, argv[1]) == NULL) {
+      continue;
+    }
+    printf("== %s\n", benches[i].name);
+    benches[i].run();
+  }
+
+  return 0;
+}
@@ -0,0 +1,121 @@
+// Copyright (c) Konstantin Belyalov. All rights reserved.
+// Licensed under the MIT license.
+//
+// Cycles per push / pop: modulo (non power of two size) vs masked
+// (power of two size) index wraparound.
+
+#include <stdint.h>
+#include "bench.h"
+#include "ring_buffer.h"
+#include "ring_buffer_fixed_size.h"
+
+// Ops are measured in batches small enough to fit into 24 bit SysTick counter on ARM
+#define BATCH    500
+#define ROUNDS   200
+
+static void bench_ring_buffer_bytes(const char* push_name, const char* pop_name, uint32_t size)
+{
+  static uint8_t buf[1024];
+  struct ring_buffer ring;
+  uint64_t push_cycles = 0;
+  uint64_t pop_cycles = 0;
+  uint8_t byte = 0;
+
+  ring_buffer_init(&ring, buf, size);
+
+  for (uint32_t round = 0; round < ROUNDS; round++) {
+    bench_cycles_t start = bench_cycles();
+    for (uint32_t i = 0; i < BATCH; i++) {
+      ring_buffer_write(&ring, &byte, 1);
+    }
+    push_cycles += bench_elapsed(start);
+
+    start = bench_cycles();
+    for (uint32_t i = 0; i < BATCH; i++) {
+      ring_buffer_read(&ring, &byte, 1);
+    }
+    pop_cycles += bench_elapsed(start);
+  }
+  bench_sink = byte;
+
+  bench_report(push_name, push_cycles, BATCH * ROUNDS);
+  bench_report(pop_name, pop_cycles, BATCH * ROUNDS);
+}
+
+RING_BUFFER_DECLARE(ring_mod, uint32_t, 1000);
+RING_BUFFER_DEFINE(ring_mod, uint32_t, 1000);
+RING_BUFFER_DECLARE(ring_pow2, uint32_t, 1024);
+RING_BUFFER_DEFINE(ring_pow2, uint32_t, 1024);
+
+#define BENCH_FIXED_SIZE(_ring, _push_name, _pop_name)            \
+  do {                                                            \
+    uint64_t push_cycles = 0;                                     \
+    uint64_t pop_cycles = 0;                                      \
+    uint32_t sum = 0;                                             \
+    for (uint32_t round = 0; round < ROUNDS; round++) {           \
+      bench_cycles_t start = bench_cycles();                      \
+      for (uint32_t i = 0; i < BATCH; i++) {                      \
+        *RING_BUFFER_PUSH(_ring) = i;                             \
+      }                                                           \
+      push_cycles += bench_elapsed(start);                        \
+      start = bench_cycles();                                     \
+      for (uint32_t i = 0; i < BATCH; i++) {                      \
+        sum += *RING_BUFFER_POP(_ring);                           \
+      }                                                           \
+      pop_cycles += bench_elapsed(start);                         \
+    }                                                             \
+    bench_sink = sum;                                             \
+    bench_report(_push_name, push_cycles, BATCH * ROUNDS);        \
+    bench_report(_pop_name, pop_cycles, BATCH * ROUNDS);          \
+  } while (0)
+
+// Draining / filling blocks of 64 ADC samples: item by item vs bulk
+#define ADC_BLOCK    64
+
+RING_BUFFER_DECLARE(adc_mod, uint16_t, 1000);
+RING_BUFFER_DEFINE(adc_mod, uint16_t, 1000);
+RING_BUFFER_DECLARE(adc_pow2, uint16_t, 1024);
+RING_BUFFER_DEFINE(adc_pow2, uint16_t, 1024);
+
+#define BENCH_FIXED_SIZE_BULK(_ring, _title)                                \
+  do {                                                                      \
+    static uint16_t samples[ADC_BLOCK];                                     \
+    uint64_t single_cycles = 0;                                             \
+    uint64_t bulk_cycles = 0;                                               \
+    uint32_t sum = 0;                                                       \
+    for (uint32_t round = 0; round < ROUNDS; round++) {                     \
+      bench_cycles_t start = bench_cycles();                                \
+      for (uint32_t i = 0; i < ADC_BLOCK; i++) {                            \
+        *RING_BUFFER_PUSH(_ring) = samples[i];                              \
+      }                                                                     \
+      for (uint32_t i = 0; i < ADC_BLOCK; i++) {                            \
+        samples[i] = *RING_BUFFER_POP(_ring);                               \
+      }                                                                     \
+      single_cycles += bench_elapsed(start);                                \
+      start = bench_cycles();                                               \
+      RING_BUFFER_PUSH_BULK(_ring, samples, ADC_BLOCK);                     \
+      sum += RING_BUFFER_POP_BULK(_ring, samples, ADC_BLOCK);               \
+      bulk_cycles += bench_elapsed(start);                                  \
+    }                                                                       \
+    bench_sink = sum + samples[0];                                          \
+    bench_report(_title " push+pop x64, per item", single_cycles,           \
+                 ADC_BLOCK * ROUNDS);                                       \
+    bench_report(_title " PUSH_BULK+POP_BULK x64, per item", bulk_cycles,   \
+                 ADC_BLOCK * ROUNDS);                                       \
+  } while (0)
+
+void bench_ring(void)
+{
+  bench_ring_buffer_bytes("ring_buffer_write 1 byte, size 1000 (modulo)",
+                          "ring_buffer_read 1 byte, size 1000 (modulo)", 1000);
+  bench_ring_buffer_bytes("ring_buffer_write 1 byte, size 1024 (mask)",
+                          "ring_buffer_read 1 byte, size 1024 (mask)", 1024);
+
+  BENCH_FIXED_SIZE(ring_mod, "RING_BUFFER_PUSH, capacity 1000",
+                   "RING_BUFFER_POP, capacity 1000");
+  BENCH_FIXED_SIZE(ring_pow2, "RING_BUFFER_PUSH, capacity 1024 (mask)",
+                   "RING_BUFFER_POP, capacity 1024 (mask)");
+
+  BENCH_FIXED_SIZE_BULK(adc_mod, "capacity 1000:");
+  BENCH_FIXED_SIZE_BULK(adc_pow2, "capacity 1024:");
+}
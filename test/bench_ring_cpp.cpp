@@ -0,0 +1,106 @@
+// Copyright (c) Konstantin Belyalov. All rights reserved.
+// Licensed under the MIT license.
+//
+// C++ template ring vs RING_BUFFER_* macros: cycles per push / pop.
+
+#include <stdint.h>
+#include "bench.h"
+#include "ring_buffer_fixed_size.h"
+#include "ring_buffer_fixed_size.hpp"
+
+#define BATCH    500
+#define ROUNDS   200
+
+RING_BUFFER_DECLARE(cpp_ring_mod, uint32_t, 1000);
+RING_BUFFER_DEFINE(cpp_ring_mod, uint32_t, 1000);
+RING_BUFFER_DECLARE(cpp_ring_pow2, uint32_t, 1024);
+RING_BUFFER_DEFINE(cpp_ring_pow2, uint32_t, 1024);
+
+#define BENCH_MACROS(_ring, _push_name, _pop_name)                \
+  do {                                                            \
+    uint64_t push_cycles = 0;                                     \
+    uint64_t pop_cycles = 0;                                      \
+    uint32_t sum = 0;                                             \
+    for (uint32_t round = 0; round < ROUNDS; round++) {           \
+      bench_cycles_t start = bench_cycles();                      \
+      for (uint32_t i = 0; i < BATCH; i++) {                      \
+        *RING_BUFFER_PUSH(_ring) = i;                             \
+      }                                                           \
+      push_cycles += bench_elapsed(start);                        \
+      start = bench_cycles();                                     \
+      for (uint32_t i = 0; i < BATCH; i++) {                      \
+        sum += *RING_BUFFER_POP(_ring);                           \
+      }                                                           \
+      pop_cycles += bench_elapsed(start);                         \
+    }                                                             \
+    bench_sink = sum;                                             \
+    bench_report(_push_name, push_cycles, BATCH * ROUNDS);        \
+    bench_report(_pop_name, pop_cycles, BATCH * ROUNDS);          \
+  } while (0)
+
+template <size_t N>
+static void bench_template(const char* push_name, const char* pop_name)
+{
+  static ring_buffer_fixed_size<uint32_t, N> ring;
+  uint64_t push_cycles = 0;
+  uint64_t pop_cycles = 0;
+  uint32_t sum = 0;
+
+  for (uint32_t round = 0; round < ROUNDS; round++) {
+    bench_cycles_t start = bench_cycles();
+    for (uint32_t i = 0; i < BATCH; i++) {
+      ring.push_overwrite(i);
+    }
+    push_cycles += bench_elapsed(start);
+    start = bench_cycles();
+    for (uint32_t i = 0; i < BATCH; i++) {
+      sum += ring.front();
+      ring.pop();
+    }
+    pop_cycles += bench_elapsed(start);
+  }
+  bench_sink = sum;
+  bench_report(push_name, push_cycles, BATCH * ROUNDS);
+  bench_report(pop_name, pop_cycles, BATCH * ROUNDS);
+}
+
+template <size_t N>
+static void bench_template_bulk(const char* push_name, const char* pop_name)
+{
+  static ring_buffer_fixed_size<uint32_t, N> ring;
+  static uint32_t items[50];
+  uint64_t push_cycles = 0;
+  uint64_t pop_cycles = 0;
+
+  for (uint32_t round = 0; round < ROUNDS; round++) {
+    bench_cycles_t start = bench_cycles();
+    for (uint32_t i = 0; i < BATCH / 50; i++) {
+      ring.push_bulk(items, 50);
+    }
+    push_cycles += bench_elapsed(start);
+    start = bench_cycles();
+    for (uint32_t i = 0; i < BATCH / 50; i++) {
+      ring.pop_bulk(items, 50);
+    }
+    pop_cycles += bench_elapsed(start);
+  }
+  bench_sink = items[0];
+  bench_report(push_name, push_cycles, BATCH * ROUNDS);
+  bench_report(pop_name, pop_cycles, BATCH * ROUNDS);
+}
+
+void bench_ring_cpp(void)
+{
+  BENCH_MACROS(cpp_ring_mod, "RING_BUFFER_PUSH, capacity 1000",
+               "RING_BUFFER_POP, capacity 1000");
+  bench_template<1000>("template push_overwrite, capacity 1000",
+                       "template front/pop, capacity 1000");
+  BENCH_MACROS(cpp_ring_pow2, "RING_BUFFER_PUSH, capacity 1024",
+               "RING_BUFFER_POP, capacity 1024");
+  bench_template<1024>("template push_overwrite, capacity 1024",
+                       "template front/pop, capacity 1024");
+  bench_template_bulk<1000>("template push_bulk x50, capacity 1000 (per item)",
+                            "template pop_bulk x50, capacity 1000 (per item)");
+  bench_template_bulk<1024>("template push_bulk x50, capacity 1024 (per item)",
+                            "template pop_bulk x50, capacity 1024 (per item)");
+}
@@ -0,0 +1,145 @@
+// Copyright (c) Konstantin Belyalov. All rights reserved.
+// Licensed under the MIT license.
+//
+// Cycles per message:
+//  - one stream per message vs batch encode / decode of radio frame worth
+//    of delimited messages
+//  - plain vs buffered (staging window) callback streams for messages
+//    wrapped around buffer end, and in place (zero copy) decode of them
+
+#include <stdint.h>
+#include "bench.h"
+#include "ring_buffer_nanopb.h"
+#include "proto/sample.pb.h"
+
+#define FRAME_MSGS   16
+#define ROUNDS       200
+
+static void bench_fill_msgs(protobufs_Test* msgs, uint32_t count)
+{
+  for (uint32_t i = 0; i < count; i++) {
+    protobufs_Test msg = protobufs_Test_init_default;
+    msg.foo = i + 1;
+    msg.bar = 0x12345678;
+    msg.baz = true;
+    msg.has_sub = true;
+    msg.sub.sub_foo = 1000 + i;
+    msg.sub.sub_bar = 0x1122334455667788ULL;
+    msgs[i] = msg;
+  }
+}
+
+static void bench_batch(void)
+{
+  // Not a power of two: frames wrap around buffer end at different offsets
+  static uint8_t buf[1000];
+  static protobufs_Test msgs[FRAME_MSGS];
+  static protobufs_Test out[FRAME_MSGS];
+  struct ring_buffer ring;
+  uint64_t single_enc = 0, single_dec = 0;
+  uint64_t batch_enc = 0, batch_dec = 0;
+  uint32_t sum = 0;
+
+  bench_fill_msgs(msgs, FRAME_MSGS);
+  ring_buffer_init(&ring, buf, sizeof(buf));
+
+  for (uint32_t round = 0; round < ROUNDS; round++) {
+    // Stream per message
+    bench_cycles_t start = bench_cycles();
+    for (uint32_t i = 0; i < FRAME_MSGS; i++) {
+      pb_ostream_t ostream = pb_ostream_from_ring_buffer(&ring);
+      pb_encode_delimited(&ostream, protobufs_Test_fields, &msgs[i]);
+    }
+    single_enc += bench_elapsed(start);
+
+    start = bench_cycles();
+    for (uint32_t i = 0; i < FRAME_MSGS; i++) {
+      pb_istream_t istream;
+      if (pb_istream_from_ring_buffer_delimited(&ring, &istream)) {
+        pb_decode(&istream, protobufs_Test_fields, &out[i]);
+      }
+    }
+    single_dec += bench_elapsed(start);
+    sum += out[FRAME_MSGS - 1].foo;
+
+    // Batch
+    start = bench_cycles();
+    pb_encode_batch_to_ring_buffer(&ring, protobufs_Test_fields, msgs, sizeof(msgs[0]), FRAME_MSGS);
+    batch_enc += bench_elapsed(start);
+
+    start = bench_cycles();
+    sum += pb_decode_batch_from_ring_buffer(&ring, protobufs_Test_fields, out, sizeof(out[0]), FRAME_MSGS);
+    batch_dec += bench_elapsed(start);
+  }
+  bench_sink = sum;
+
+  bench_report("encode, stream per message", single_enc, FRAME_MSGS * ROUNDS);
+  bench_report("encode, batch of 16", batch_enc, FRAME_MSGS * ROUNDS);
+  bench_report("decode, stream per message", single_dec, FRAME_MSGS * ROUNDS);
+  bench_report("decode, batch of 16", batch_dec, FRAME_MSGS * ROUNDS);
+}
+
+static void bench_buffered(void)
+{
+  static uint8_t buf[protobufs_Test_size + 1];
+  protobufs_Test msg;
+  protobufs_Test out;
+  struct ring_buffer ring;
+  uint64_t plain_enc = 0, plain_dec = 0;
+  uint64_t buffered_enc = 0, buffered_dec = 0;
+  uint64_t zero_copy_dec = 0;
+  uint32_t sum = 0;
+  size_t msg_len;
+
+  bench_fill_msgs(&msg, 1);
+  pb_get_encoded_size(&msg_len, protobufs_Test_fields, &msg);
+  // Buffer is 1 byte longer than message: almost every message wraps
+  // around buffer end
+  ring_buffer_init(&ring, buf, msg_len + 1);
+
+  for (uint32_t round = 0; round < ROUNDS * FRAME_MSGS; round++) {
+    bench_cycles_t start = bench_cycles();
+    pb_ostream_t ostream = pb_ostream_from_ring_buffer(&ring);
+    pb_encode(&ostream, protobufs_Test_fields, &msg);
+    plain_enc += bench_elapsed(start);
+
+    start = bench_cycles();
+    pb_istream_t istream = pb_istream_from_ring_buffer(&ring, msg_len);
+    pb_decode(&istream, protobufs_Test_fields, &out);
+    plain_dec += bench_elapsed(start);
+    sum += out.foo;
+
+    struct pb_ring_buffer_ostream ostate;
+    start = bench_cycles();
+    ostream = pb_ostream_from_ring_buffer_buffered(&ostate, &ring);
+    pb_encode(&ostream, protobufs_Test_fields, &msg);
+    pb_ring_buffer_ostream_flush(&ostate);
+    buffered_enc += bench_elapsed(start);
+
+    struct pb_ring_buffer_istream istate;
+    start = bench_cycles();
+    istream = pb_istream_from_ring_buffer_buffered(&istate, &ring, msg_len);
+    pb_decode(&istream, protobufs_Test_fields, &out);
+    buffered_dec += bench_elapsed(start);
+    sum += out.foo;
+
+    pb_encode_to_ring_buffer(&ring, protobufs_Test_fields, &msg);
+    start = bench_cycles();
+    pb_decode_from_ring_buffer(&ring, msg_len, protobufs_Test_fields, &out);
+    zero_copy_dec += bench_elapsed(start);
+    sum += out.foo;
+  }
+  bench_sink = sum;
+
+  bench_report("encode wrapped message, plain stream", plain_enc, FRAME_MSGS * ROUNDS);
+  bench_report("encode wrapped message, buffered stream", buffered_enc, FRAME_MSGS * ROUNDS);
+  bench_report("decode wrapped message, plain stream", plain_dec, FRAME_MSGS * ROUNDS);
+  bench_report("decode wrapped message, buffered stream", buffered_dec, FRAME_MSGS * ROUNDS);
+  bench_report("decode wrapped message, zero copy", zero_copy_dec, FRAME_MSGS * ROUNDS);
+}
+
+void bench_ring_nanopb(void)
+{
+  bench_batch();
+  bench_buffered();
+}
@@ -0,0 +1,338 @@
+// Copyright (c) Konstantin Belyalov. All rights reserved.
+// Licensed under the MIT license.
+//
+// Cycles per static_alloc_alloc() / static_alloc_free() pair across pool fill
+// levels and fragmentation patterns, placement policies on allocation trace.
+// Built with STATIC_ALLOC_BUDDY ("make bench_buddy") the same patterns / traces
+// measure buddy backend.
+
+#include <stdint.h>
+#include "bench.h"
+#include "static_alloc.h"
+
+#define ROUNDS       200
+// 127 user blocks: fits into RAM of the smallest parts
+#define POOL_SIZE    8192
+#define MAX_ITEMS    (POOL_SIZE / STATIC_ALLOC_BLOCK_SIZE)
+
+static uint8_t pool[POOL_SIZE];
+static void*   items[MAX_ITEMS];
+
+// Fills "percent" of pool with single block items.
+// "holes": free every other item afterwards, so free space is fragmented
+// into single block holes.
+static uint32_t bench_fill(uint32_t percent, int holes)
+{
+  uint32_t total = static_alloc_info_mem_free() / STATIC_ALLOC_BLOCK_SIZE;
+  uint32_t count = total * percent / 100;
+
+  for (uint32_t i = 0; i < count; i++) {
+    items[i] = static_alloc_alloc(1);
+  }
+  if (holes) {
+    for (uint32_t i = 0; i < count; i += 2) {
+      static_alloc_free(items[i]);
+      items[i] = NULL;
+    }
+  }
+
+  return count;
+}
+
+static void bench_pattern(const char* name, uint32_t percent, int holes, uint32_t size)
+{
+  uint64_t alloc_cycles = 0;
+  uint64_t free_cycles = 0;
+  uint32_t ok = 0;
+
+  static_alloc_init(pool, sizeof(pool));
+  uint32_t count = bench_fill(percent, holes);
+
+  for (uint32_t round = 0; round < ROUNDS; round++) {
+    bench_cycles_t start = bench_cycles();
+    void* p = static_alloc_alloc(size);
+    alloc_cycles += bench_elapsed(start);
+    if (p) {
+      ok++;
+      start = bench_cycles();
+      static_alloc_free(p);
+      free_cycles += bench_elapsed(start);
+    }
+  }
+  bench_sink = ok + static_alloc_info_mem_free();
+
+  for (uint32_t i = 0; i < count; i++) {
+    if (items[i]) {
+      static_alloc_free(items[i]);
+    }
+  }
+
+  bench_report(name, alloc_cycles, ROUNDS);
+  // Failed allocations have nothing to free
+  if (ok) {
+    printf("%-48s %10.2f cycles/op free\n", "", (double)free_cycles / ok);
+  }
+}
+
+static void bench_classes(void)
+{
+  static struct static_alloc_class classes[] = {
+    {32, 8},
+    {128, 8},
+  };
+  uint64_t cycles = 0;
+
+  static_alloc_init(pool, sizeof(pool));
+  static_alloc_init_classes(classes, 2);
+  // Pool is 90% full: regular allocation would scan almost whole bitmap
+  uint32_t count = bench_fill(90, 0);
+
+  for (uint32_t round = 0; round < ROUNDS; round++) {
+    bench_cycles_t start = bench_cycles();
+    void* p = static_alloc_alloc(100);
+    cycles += bench_elapsed(start);
+    static_alloc_free(p);
+  }
+  bench_sink = classes[1].hits;
+  for (uint32_t i = 0; i < count; i++) {
+    static_alloc_free(items[i]);
+  }
+
+  bench_report("alloc 100 bytes, size class hit, pool 90% full", cycles, ROUNDS);
+}
+
+// Worst case of interrupt safe path: the last configured class (every class
+// is checked before it). Besides average, the slowest call is reported -
+// that is what interrupt latency budget is about.
+static void bench_alloc_isr(void)
+{
+  static struct static_alloc_class classes[] = {
+    {16, 4},
+    {32, 4},
+    {64, 4},
+    {128, 4},
+  };
+  uint64_t alloc_cycles = 0;
+  uint64_t free_cycles = 0;
+  bench_cycles_t alloc_worst = 0;
+  bench_cycles_t free_worst = 0;
+
+  static_alloc_init(pool, sizeof(pool));
+  static_alloc_init_classes(classes, 4);
+
+  for (uint32_t round = 0; round < ROUNDS; round++) {
+    bench_cycles_t start = bench_cycles();
+    void* p = static_alloc_alloc_isr(128);
+    bench_cycles_t elapsed = bench_elapsed(start);
+    alloc_cycles += elapsed;
+    if (elapsed > alloc_worst) {
+      alloc_worst = elapsed;
+    }
+    start = bench_cycles();
+    static_alloc_free(p);
+    elapsed = bench_elapsed(start);
+    free_cycles += elapsed;
+    if (elapsed > free_worst) {
+      free_worst = elapsed;
+    }
+  }
+  bench_sink = classes[3].hits;
+
+  bench_report("alloc_isr 128 bytes, 4th size class", alloc_cycles, ROUNDS);
+  printf("%-48s %10u cycles worst\n", "", (unsigned)alloc_worst);
+  bench_report("free of size class item", free_cycles, ROUNDS);
+  printf("%-48s %10u cycles worst\n", "", (unsigned)free_worst);
+}
+
+// Trace replay: the same allocation trace for every placement policy.
+// Trace is synthetic, but follows typical firmware pattern: packets of
+// random size being allocated / released all the time, while long lived
+// objects (sessions, configs) are created every now and then.
+#define TRACE_OPS          20000
+#define TRACE_SLOTS        48
+#define TRACE_LONG_LIVED   8
+#define TRACE_LONG_EVERY   (TRACE_OPS / TRACE_LONG_LIVED)
+
+static uint32_t trace_seed;
+
+static uint32_t trace_random(void)
+{
+  trace_seed = trace_seed * 1103515245 + 12345;
+  return trace_seed >> 16;
+}
+
+static void bench_trace(const char* name, enum static_alloc_policy policy, uint32_t long_lived_flags)
+{
+  static void* slots[TRACE_SLOTS];
+  static void* long_lived[TRACE_LONG_LIVED];
+  struct static_alloc_stats stats;
+  uint64_t cycles = 0;
+  uint32_t allocs = 0;
+  uint32_t failed = 0;
+  uint32_t frag_sum = 0;
+  uint32_t frag_samples = 0;
+
+  static_alloc_init(pool, sizeof(pool));
+  static_alloc_set_policy(policy);
+  trace_seed = 1;
+  for (uint32_t i = 0; i < TRACE_SLOTS; i++) {
+    slots[i] = NULL;
+  }
+
+  for (uint32_t op = 0; op < TRACE_OPS; op++) {
+    if (op % TRACE_LONG_EVERY == 0) {
+      // Never released
+      long_lived[op / TRACE_LONG_EVERY] = static_alloc_alloc_ex(100 + trace_random() % 200, long_lived_flags);
+    }
+    uint32_t slot = trace_random() % TRACE_SLOTS;
+    if (slots[slot]) {
+      static_alloc_free(slots[slot]);
+      slots[slot] = NULL;
+      continue;
+    }
+    // Mostly small packets, sometimes large ones
+    uint32_t size = trace_random() % 8 == 0 ? 200 + trace_random() % 300 : 10 + trace_random() % 120;
+    bench_cycles_t start = bench_cycles();
+    slots[slot] = static_alloc_alloc(size);
+    cycles += bench_elapsed(start);
+    allocs++;
+    if (slots[slot] == NULL) {
+      failed++;
+    }
+    if (op % 64 == 0) {
+      // Fragmentation: free memory not usable for largest item possible
+      static_alloc_stats(&stats);
+      if (stats.bytes_free) {
+        frag_sum += 100 - stats.largest_free * 100 / stats.bytes_free;
+        frag_samples++;
+      }
+    }
+  }
+
+  for (uint32_t i = 0; i < TRACE_SLOTS; i++) {
+    if (slots[i]) {
+      static_alloc_free(slots[i]);
+    }
+  }
+  for (uint32_t i = 0; i < TRACE_LONG_LIVED; i++) {
+    if (long_lived[i]) {
+      static_alloc_free(long_lived[i]);
+    }
+  }
+  static_alloc_set_policy(STATIC_ALLOC_FIRST_FIT);
+
+  bench_report(name, cycles, allocs);
+  printf("%-48s %10u failed, %u%% fragmentation\n", "", (unsigned)failed,
+         (unsigned)(frag_samples ? frag_sum / frag_samples : 0));
+}
+
+// Mixed trace: small records all the time, occasional large frames (1-1.5KB,
+// e.g. radio / USB packets). Alloc and free cycles are reported separately,
+// fragmentation is sampled right before frame allocation.
+#define FRAMES_OPS         20000
+#define FRAMES_RECORDS     64
+#define FRAMES_SLOTS       3
+#define FRAMES_EVERY       16
+
+static void bench_frames(void)
+{
+  static void* records[FRAMES_RECORDS];
+  static void* frames[FRAMES_SLOTS];
+  struct static_alloc_stats stats;
+  uint64_t alloc_cycles = 0;
+  uint64_t free_cycles = 0;
+  uint32_t allocs = 0;
+  uint32_t frees = 0;
+  uint32_t failed = 0;
+  uint32_t frag_sum = 0;
+  uint32_t frag_samples = 0;
+
+  static_alloc_init(pool, sizeof(pool));
+  trace_seed = 1;
+  for (uint32_t i = 0; i < FRAMES_RECORDS; i++) {
+    records[i] = NULL;
+  }
+  for (uint32_t i = 0; i < FRAMES_SLOTS; i++) {
+    frames[i] = NULL;
+  }
+
+  for (uint32_t op = 0; op < FRAMES_OPS; op++) {
+    void** slot;
+    uint32_t size;
+    if (op % FRAMES_EVERY == 0) {
+      slot = &frames[trace_random() % FRAMES_SLOTS];
+      size = 1000 + trace_random() % 500;
+      if (*slot == NULL) {
+        static_alloc_stats(&stats);
+        if (stats.bytes_free) {
+          frag_sum += 100 - stats.largest_free * 100 / stats.bytes_free;
+          frag_samples++;
+        }
+      }
+    } else {
+      slot = &records[trace_random() % FRAMES_RECORDS];
+      size = 40 + trace_random() % 20;
+    }
+    bench_cycles_t start = bench_cycles();
+    if (*slot) {
+      static_alloc_free(*slot);
+      free_cycles += bench_elapsed(start);
+      frees++;
+      *slot = NULL;
+      continue;
+    }
+    *slot = static_alloc_alloc(size);
+    alloc_cycles += bench_elapsed(start);
+    allocs++;
+    if (*slot == NULL) {
+      failed++;
+    }
+  }
+
+  for (uint32_t i = 0; i < FRAMES_RECORDS; i++) {
+    if (records[i]) {
+      static_alloc_free(records[i]);
+    }
+  }
+  for (uint32_t i = 0; i < FRAMES_SLOTS; i++) {
+    if (frames[i]) {
+      static_alloc_free(frames[i]);
+    }
+  }
+
+  bench_report("frames trace: alloc", alloc_cycles, allocs);
+  bench_report("frames trace: free", free_cycles, frees);
+  printf("%-48s %10u failed, %u%% fragmentation\n", "", (unsigned)failed,
+         (unsigned)(frag_samples ? frag_sum / frag_samples : 0));
+}
+
+static void bench_mem_free(void)
+{
+  static_alloc_init(pool, sizeof(pool));
+  bench_fill(50, 1);
+
+  bench_cycles_t start = bench_cycles();
+  for (uint32_t round = 0; round < ROUNDS; round++) {
+    bench_sink = static_alloc_info_mem_free();
+  }
+  bench_report("static_alloc_info_mem_free, 127 blocks", bench_elapsed(start), ROUNDS);
+}
+
+void bench_static_alloc(void)
+{
+  bench_pattern("alloc 1 block, empty pool", 0, 0, 1);
+  bench_pattern("alloc 1 block, pool 50% full", 50, 0, 1);
+  bench_pattern("alloc 1 block, pool 90% full", 90, 0, 1);
+  bench_pattern("alloc 4 blocks, pool 90% full", 90, 0, 200);
+  bench_pattern("alloc 1 block, 50% fragmented (holes)", 100, 1, 1);
+  bench_pattern("alloc 2 blocks, 50% fragmented (fails)", 100, 1, 100);
+  bench_pattern("alloc 2 blocks, 90% full, holes before", 90, 1, 100);
+  bench_classes();
+  bench_alloc_isr();
+  bench_mem_free();
+  bench_trace("trace replay: first fit", STATIC_ALLOC_FIRST_FIT, 0);
+  bench_trace("trace replay: next fit", STATIC_ALLOC_NEXT_FIT, 0);
+  bench_trace("trace replay: best fit", STATIC_ALLOC_BEST_FIT, 0);
+  bench_trace("trace replay: first fit, long lived at top", STATIC_ALLOC_FIRST_FIT, STATIC_ALLOC_LONG_LIVED);
+  bench_frames();
+}
@@ -51,6 +51,14 @@ typedef struct
 {
 } UART_HandleTypeDef;
 
+typedef struct
+{
+  // Mock of DMA channel NDTR / CNDTR register: number of data items remaining
+  volatile uint32_t counter;
+} DMA_HandleTypeDef;
+
+#define __HAL_DMA_GET_COUNTER(__HANDLE__) ((__HANDLE__)->counter)
+
 // HAL function mocks
 
 // SPI mocks
@@ -12,4 +12,7 @@ PB_BIND(protobufs_Test, protobufs_Test, AUTO)
 PB_BIND(protobufs_SubTest, protobufs_SubTest, AUTO)
 
 
+PB_BIND(protobufs_CallbackTest, protobufs_CallbackTest, AUTO)
+
+
 
@@ -23,6 +23,11 @@ typedef struct _protobufs_Test {
     protobufs_SubTest sub;
 } protobufs_Test;
 
+typedef struct _protobufs_CallbackTest {
+    uint32_t foo;
+    pb_callback_t data;
+} protobufs_CallbackTest;
+
 
 #ifdef __cplusplus
 extern "C" {
@@ -31,8 +36,10 @@ extern "C" {
 /* Initializer values for message structs */
 #define protobufs_Test_init_default              {0, 0, 0, false, protobufs_SubTest_init_default}
 #define protobufs_SubTest_init_default           {0, 0}
+#define protobufs_CallbackTest_init_default      {0, {{NULL}, NULL}}
 #define protobufs_Test_init_zero                 {0, 0, 0, false, protobufs_SubTest_init_zero}
 #define protobufs_SubTest_init_zero              {0, 0}
+#define protobufs_CallbackTest_init_zero         {0, {{NULL}, NULL}}
 
 /* Field tags (for use in manual encoding/decoding) */
 #define protobufs_SubTest_sub_foo_tag            1
@@ -41,6 +48,8 @@ extern "C" {
 #define protobufs_Test_bar_tag                   2
 #define protobufs_Test_baz_tag                   3
 #define protobufs_Test_sub_tag                   4
+#define protobufs_CallbackTest_foo_tag           1
+#define protobufs_CallbackTest_data_tag          2
 
 /* Struct field encoding specification for nanopb */
 #define protobufs_Test_FIELDLIST(X, a) \
@@ -58,14 +67,23 @@ X(a, STATIC,   SINGULAR, FIXED64,  sub_bar,           2)
 #define protobufs_SubTest_CALLBACK NULL
 #define protobufs_SubTest_DEFAULT NULL
 
+#define protobufs_CallbackTest_FIELDLIST(X, a) \
+X(a, STATIC,   SINGULAR, UINT32,   foo,               1) \
+X(a, CALLBACK, SINGULAR, BYTES,    data,              2)
+#define protobufs_CallbackTest_CALLBACK pb_default_field_callback
+#define protobufs_CallbackTest_DEFAULT NULL
+
 extern const pb_msgdesc_t protobufs_Test_msg;
 extern const pb_msgdesc_t protobufs_SubTest_msg;
+extern const pb_msgdesc_t protobufs_CallbackTest_msg;
 
 /* Defines for backwards compatibility with code written before nanopb-0.4.0 */
 #define protobufs_Test_fields &protobufs_Test_msg
 #define protobufs_SubTest_fields &protobufs_SubTest_msg
+#define protobufs_CallbackTest_fields &protobufs_CallbackTest_msg
 
 /* Maximum encoded size of messages (where known) */
+/* protobufs_CallbackTest_size depends on runtime parameters */
 #define protobufs_Test_size                      30
 #define protobufs_SubTest_size                   15
 
@@ -0,0 +1,214 @@
+// Copyright (c) Konstantin Belyalov. All rights reserved.
+// Licensed under the MIT license.
+//
+// Host replay of static_alloc trace recorded on device (STATIC_ALLOC_TRACE,
+// raw struct static_alloc_trace_event array dumped out of trace ring).
+// Trace is fed through static_alloc.c with given pool configuration, so
+// pool size / size classes / placement policy may be tuned on real
+// allocation pattern.
+//
+// Usage: static_alloc_replay [-p pool_size] [-P first|next|best]
+//                            [-c size:count,...] [-i interval] trace.bin
+//
+// Reports alloc / free latency percentiles, peak usage and fragmentation
+// timeline (every "interval" events).
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "bench.h"
+#include "static_alloc.h"
+
+#define MAX_CLASSES   16
+
+volatile uint32_t bench_sink;
+
+static int cmp_cycles(const void* a, const void* b)
+{
+  bench_cycles_t x = *(const bench_cycles_t*)a;
+  bench_cycles_t y = *(const bench_cycles_t*)b;
+
+  return x < y ? -1 : x > y;
+}
+
+static void report_latency(const char* name, bench_cycles_t* cycles, uint32_t count)
+{
+  if (count == 0) {
+    return;
+  }
+  qsort(cycles, count, sizeof(cycles[0]), cmp_cycles);
+  printf("%-8s p50 %6llu  p90 %6llu  p99 %6llu  max %6llu cycles\n", name,
+         (unsigned long long)cycles[count / 2],
+         (unsigned long long)cycles[count * 90 / 100],
+         (unsigned long long)cycles[count * 99 / 100],
+         (unsigned long long)cycles[count - 1]);
+}
+
+static void report_timeline(uint32_t event, uint32_t timestamp)
+{
+  struct static_alloc_stats stats;
+
+  static_alloc_stats(&stats);
+  printf("%8u %10u %8u %8u %8u %5u%%\n", event, timestamp, stats.bytes_used, stats.bytes_free,
+         stats.largest_free, stats.bytes_free ? 100 - stats.largest_free * 100 / stats.bytes_free : 0);
+}
+
+static uint32_t parse_classes(char* arg, struct static_alloc_class* classes)
+{
+  uint32_t count = 0;
+
+  for (char* tok = strtok(arg, ","); tok && count < MAX_CLASSES; tok = strtok(NULL, ",")) {
+    if (sscanf(tok, "%u:%u", &classes[count].size, &classes[count].count) == 2) {
+      count++;
+    }
+  }
+
+  return count;
+}
+
+int main(int argc, char** argv)
+{
+  struct static_alloc_class classes[MAX_CLASSES];
+  enum static_alloc_policy policy = STATIC_ALLOC_FIRST_FIT;
+  uint32_t pool_size = 8192;
+  uint32_t classes_count = 0;
+  uint32_t interval = 0;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "p:P:c:i:")) != -1) {
+    switch (opt) {
+      case 'p':
+        pool_size = strtoul(optarg, NULL, 0);
+        break;
+      case 'P':
+        policy = !strcmp(optarg, "next") ? STATIC_ALLOC_NEXT_FIT :
+                 !strcmp(optarg, "best") ? STATIC_ALLOC_BEST_FIT : STATIC_ALLOC_FIRST_FIT;
+        break;
+      case 'c':
+        classes_count = parse_classes(optarg, classes);
+        break;
+      case 'i':
+        interval = strtoul(optarg, NULL, 0);
+        break;
+      default:
+        fprintf(stderr, "usage: %s [-p pool_size] [-P first|next|best] [-c size:count,...] "
+                "[-i interval] trace.bin\n", argv[0]);
+        return 1;
+    }
+  }
+  if (optind >= argc) {
+    fprintf(stderr, "trace file required\n");
+    return 1;
+  }
+
+  // Load whole trace
+  FILE* f = fopen(argv[optind], "rb");
+  if (f == NULL) {
+    perror(argv[optind]);
+    return 1;
+  }
+  fseek(f, 0, SEEK_END);
+  uint32_t count = ftell(f) / sizeof(struct static_alloc_trace_event);
+  fseek(f, 0, SEEK_SET);
+  struct static_alloc_trace_event* events = malloc(count * sizeof(events[0]) + 1);
+  if (fread(events, sizeof(events[0]), count, f) != count) {
+    perror("read");
+    return 1;
+  }
+  fclose(f);
+
+  uint8_t* pool = malloc(pool_size);
+  bench_cycles_t* alloc_cycles = malloc(count * sizeof(bench_cycles_t) + 1);
+  bench_cycles_t* free_cycles = malloc(count * sizeof(bench_cycles_t) + 1);
+  // Recorded block index -> replayed item
+  void** items = calloc(STATIC_ALLOC_TRACE_NO_BLOCK + 1, sizeof(void*));
+  uint32_t allocs = 0;
+  uint32_t frees = 0;
+  uint32_t recorded_failures = 0;
+  uint32_t failures = 0;
+
+  static_alloc_init(pool, pool_size);
+  if (classes_count && !static_alloc_init_classes(classes, classes_count)) {
+    fprintf(stderr, "not enough memory for size classes\n");
+    return 1;
+  }
+  static_alloc_set_policy(policy);
+  if (interval == 0) {
+    interval = count / 20 + 1;
+  }
+
+  printf("%8s %10s %8s %8s %8s %6s\n", "event", "timestamp", "used", "free", "largest", "frag");
+  for (uint32_t i = 0; i < count; i++) {
+    struct static_alloc_trace_event* ev = &events[i];
+    void** item = &items[ev->block];
+    bench_cycles_t start;
+    void* ptr;
+
+    switch (ev->op) {
+      case STATIC_ALLOC_TRACE_ALLOC:
+        start = bench_cycles();
+        if (ev->flags & STATIC_ALLOC_TRACE_ISR) {
+          ptr = static_alloc_alloc_isr(ev->size);
+        } else {
+          ptr = static_alloc_alloc_ex(ev->size, ev->flags);
+        }
+        alloc_cycles[allocs++] = bench_elapsed(start);
+        if (ptr == NULL) {
+          failures++;
+        }
+        if (ev->block == STATIC_ALLOC_TRACE_NO_BLOCK) {
+          // Failed on device: never used there
+          recorded_failures++;
+          if (ptr) {
+            static_alloc_free(ptr);
+          }
+          break;
+        }
+        *item = ptr;
+        break;
+      case STATIC_ALLOC_TRACE_COPY:
+        if (*item) {
+          static_alloc_copy(*item);
+        }
+        break;
+      case STATIC_ALLOC_TRACE_REALLOC:
+        if (*item) {
+          ptr = static_alloc_realloc(*item, ev->size);
+          if (ptr) {
+            *item = ptr;
+          } else {
+            failures++;
+          }
+        }
+        break;
+      case STATIC_ALLOC_TRACE_FREE:
+        // Item allocated before recording started / failed in replay
+        if (*item) {
+          start = bench_cycles();
+          static_alloc_free(*item);
+          free_cycles[frees++] = bench_elapsed(start);
+        }
+        break;
+    }
+    if (i % interval == 0) {
+      report_timeline(i, ev->timestamp);
+    }
+  }
+  if (count) {
+    report_timeline(count - 1, events[count - 1].timestamp);
+  }
+
+  struct static_alloc_stats stats;
+  static_alloc_stats(&stats);
+  printf("\n%u events, %u allocs, %u frees\n", count, allocs, frees);
+  printf("failed allocs: %u (on device: %u)\n", failures, recorded_failures);
+  printf("peak used: %u bytes, high water: %u bytes (pool %u bytes)\n", stats.bytes_peak, stats.high_water,
+         pool_size);
+  for (uint32_t c = 0; c < classes_count; c++) {
+    printf("class %u bytes: %u hits, %u misses\n", classes[c].size, classes[c].hits, classes[c].misses);
+  }
+  report_latency("alloc", alloc_cycles, allocs);
+  report_latency("free", free_cycles, frees);
+
+  return 0;
+}
@@ -119,3 +119,303 @@ TEST(ring_buffer, reset)
   ring_buffer_reset(&ring);
   ASSERT_EQ(0, ring_buffer_used(&ring));
 }
+
+TEST(ring_buffer, write_reserve_commit)
+{
+  struct ring_buffer ring;
+  uint8_t ringbuf[10] = {};
+  ring_buffer_init(&ring, ringbuf, sizeof(ringbuf));
+  struct ring_buffer_span spans[2];
+
+  // Contiguous region: second span is empty
+  ASSERT_EQ(4, ring_buffer_write_reserve(&ring, 4, spans));
+  ASSERT_EQ(ringbuf, spans[0].buf);
+  ASSERT_EQ(4, spans[0].len);
+  ASSERT_EQ(0, spans[1].len);
+  for (size_t i = 0; i < 4; i++) {
+    spans[0].buf[i] = i + 1;
+  }
+  // Reserve does not change anything until commit
+  ASSERT_EQ(0, ring_buffer_used(&ring));
+  ASSERT_TRUE(ring_buffer_write_commit(&ring, 4));
+  ASSERT_EQ(4, ring_buffer_used(&ring));
+
+  // Reserve is limited by free space
+  ASSERT_EQ(6, ring_buffer_write_reserve(&ring, 20, spans));
+  ASSERT_FALSE(ring_buffer_write_commit(&ring, 7));
+
+  // Read all, then reserve region which wraps around buffer end
+  uint8_t rd[10] = {};
+  ASSERT_TRUE(ring_buffer_read(&ring, rd, 4));
+  ASSERT_EQ(8, ring_buffer_write_reserve(&ring, 8, spans));
+  ASSERT_EQ(&ringbuf[4], spans[0].buf);
+  ASSERT_EQ(6, spans[0].len);
+  ASSERT_EQ(ringbuf, spans[1].buf);
+  ASSERT_EQ(2, spans[1].len);
+  for (size_t i = 0; i < spans[0].len; i++) {
+    spans[0].buf[i] = 10 + i;
+  }
+  for (size_t i = 0; i < spans[1].len; i++) {
+    spans[1].buf[i] = 10 + spans[0].len + i;
+  }
+  ASSERT_TRUE(ring_buffer_write_commit(&ring, 8));
+  ASSERT_EQ(8, ring_buffer_used(&ring));
+
+  // Data must be readable with regular read
+  ASSERT_TRUE(ring_buffer_read(&ring, rd, 8));
+  for (size_t i = 0; i < 8; i++) {
+    ASSERT_EQ(10 + i, rd[i]) << "index " << i;
+  }
+}
+
+TEST(ring_buffer, read_peek_consume)
+{
+  struct ring_buffer ring;
+  uint8_t ringbuf[10] = {};
+  ring_buffer_init(&ring, ringbuf, sizeof(ringbuf));
+  struct ring_buffer_span spans[2];
+
+  // Peek from empty buffer
+  ASSERT_EQ(0, ring_buffer_read_peek(&ring, 5, spans));
+  ASSERT_EQ(0, spans[0].len);
+  ASSERT_EQ(0, spans[1].len);
+  ASSERT_FALSE(ring_buffer_read_consume(&ring, 1));
+
+  // Move head/tail close to buffer end, then write rolled over data
+  uint8_t wr[10] = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10};
+  ASSERT_TRUE(ring_buffer_write(&ring, wr, 7));
+  ASSERT_TRUE(ring_buffer_read_consume(&ring, 7));
+  ASSERT_TRUE(ring_buffer_write(&ring, wr, 6));
+
+  // Peek is limited by amount of data
+  ASSERT_EQ(6, ring_buffer_read_peek(&ring, 10, spans));
+  ASSERT_EQ(&ringbuf[7], spans[0].buf);
+  ASSERT_EQ(3, spans[0].len);
+  ASSERT_EQ(ringbuf, spans[1].buf);
+  ASSERT_EQ(3, spans[1].len);
+  for (size_t i = 0; i < 3; i++) {
+    ASSERT_EQ(wr[i], spans[0].buf[i]);
+    ASSERT_EQ(wr[i + 3], spans[1].buf[i]);
+  }
+  // Peek does not consume data
+  ASSERT_EQ(6, ring_buffer_used(&ring));
+
+  // Partial consume
+  ASSERT_TRUE(ring_buffer_read_consume(&ring, 4));
+  ASSERT_EQ(2, ring_buffer_used(&ring));
+  ASSERT_EQ(2, ring_buffer_read_peek(&ring, 10, spans));
+  ASSERT_EQ(&ringbuf[1], spans[0].buf);
+  ASSERT_EQ(5, spans[0].buf[0]);
+  ASSERT_EQ(6, spans[0].buf[1]);
+  ASSERT_FALSE(ring_buffer_read_consume(&ring, 3));
+  ASSERT_TRUE(ring_buffer_read_consume(&ring, 2));
+  ASSERT_EQ(0, ring_buffer_used(&ring));
+}
+
+TEST(ring_buffer, pow2_mode)
+{
+  struct ring_buffer ring;
+  uint8_t ringbuf[8] = {};
+  ring_buffer_init(&ring, ringbuf, sizeof(ringbuf));
+  // Power of two size selects masked mode
+  ASSERT_EQ(7, ring.mask);
+
+  // Full buffer is distinguishable from empty
+  uint8_t wr[8] = {1, 2, 3, 4, 5, 6, 7, 8};
+  ASSERT_TRUE(ring_buffer_write(&ring, wr, 8));
+  ASSERT_EQ(8, ring_buffer_used(&ring));
+  ASSERT_EQ(0, ring_buffer_free(&ring));
+  ASSERT_FALSE(ring_buffer_write(&ring, wr, 1));
+
+  uint8_t rd[8] = {};
+  ASSERT_TRUE(ring_buffer_read(&ring, rd, 5));
+  for (size_t i = 0; i < 5; i++) {
+    ASSERT_EQ(wr[i], rd[i]) << "index " << i;
+  }
+
+  // Rollover
+  ASSERT_TRUE(ring_buffer_write(&ring, wr, 5));
+  ASSERT_TRUE(ring_buffer_read(&ring, rd, 8));
+  uint8_t expected[8] = {6, 7, 8, 1, 2, 3, 4, 5};
+  for (size_t i = 0; i < 8; i++) {
+    ASSERT_EQ(expected[i], rd[i]) << "index " << i;
+  }
+  ASSERT_EQ(0, ring_buffer_used(&ring));
+
+  // Free running indexes close to uint32_t overflow
+  ring.head = 0xfffffffd;
+  ring.tail = 0xfffffffd;
+  ASSERT_TRUE(ring_buffer_write(&ring, wr, 6));
+  ASSERT_EQ(6, ring_buffer_used(&ring));
+  struct ring_buffer_span spans[2];
+  ASSERT_EQ(6, ring_buffer_read_peek(&ring, 8, spans));
+  ASSERT_EQ(&ringbuf[5], spans[0].buf);
+  ASSERT_EQ(3, spans[0].len);
+  ASSERT_EQ(3, spans[1].len);
+  ASSERT_TRUE(ring_buffer_read(&ring, rd, 6));
+  for (size_t i = 0; i < 6; i++) {
+    ASSERT_EQ(wr[i], rd[i]) << "index " << i;
+  }
+  ASSERT_EQ(0, ring_buffer_used(&ring));
+
+  // Reset
+  ring_buffer_advance_head(&ring, 3);
+  ASSERT_EQ(3, ring_buffer_used(&ring));
+  ring_buffer_reset(&ring);
+  ASSERT_EQ(0, ring_buffer_used(&ring));
+}
+
+TEST(ring_buffer, records)
+{
+  struct ring_buffer ring;
+  uint8_t ringbuf[20] = {};
+  ring_buffer_init(&ring, ringbuf, sizeof(ringbuf));
+  uint32_t size = 0;
+
+  // No records
+  ASSERT_FALSE(ring_buffer_next_record_size(&ring, &size));
+
+  // Write 2 records: 1 byte header + payload each
+  uint8_t wr[16] = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16};
+  ASSERT_TRUE(ring_buffer_write_record(&ring, wr, 5));
+  ASSERT_TRUE(ring_buffer_write_record(&ring, wr, 0));
+  ASSERT_EQ(7, ring_buffer_used(&ring));
+
+  // Record which does not fit is not written at all
+  ASSERT_FALSE(ring_buffer_write_record(&ring, wr, 13));
+  ASSERT_EQ(7, ring_buffer_used(&ring));
+
+  // Read records back
+  ASSERT_TRUE(ring_buffer_next_record_size(&ring, &size));
+  ASSERT_EQ(5, size);
+  uint8_t rd[16] = {};
+  // Too small buffer: record stays in ring
+  ASSERT_FALSE(ring_buffer_read_record(&ring, rd, 4, &size));
+  ASSERT_EQ(7, ring_buffer_used(&ring));
+  ASSERT_TRUE(ring_buffer_read_record(&ring, rd, sizeof(rd), &size));
+  ASSERT_EQ(5, size);
+  for (size_t i = 0; i < 5; i++) {
+    ASSERT_EQ(wr[i], rd[i]) << "index " << i;
+  }
+  // Empty record
+  ASSERT_TRUE(ring_buffer_read_record(&ring, rd, sizeof(rd), &size));
+  ASSERT_EQ(0, size);
+  ASSERT_EQ(0, ring_buffer_used(&ring));
+  ASSERT_FALSE(ring_buffer_read_record(&ring, rd, sizeof(rd), &size));
+
+  // Records rolled over buffer end (header / payload split)
+  for (uint32_t round = 0; round < 10; round++) {
+    uint32_t len = 3 + round % 10;
+    ASSERT_TRUE(ring_buffer_write_record(&ring, &wr[round], len));
+    ASSERT_TRUE(ring_buffer_next_record_size(&ring, &size));
+    ASSERT_EQ(len, size);
+    ASSERT_TRUE(ring_buffer_read_record(&ring, rd, sizeof(rd), &size));
+    ASSERT_EQ(len, size);
+    for (size_t i = 0; i < len; i++) {
+      ASSERT_EQ(wr[round + i], rd[i]) << "round " << round << " index " << i;
+    }
+  }
+  ASSERT_EQ(0, ring_buffer_used(&ring));
+}
+
+TEST(ring_buffer, records_long)
+{
+  // Power of two ring, records with 2 bytes length header
+  struct ring_buffer ring;
+  uint8_t ringbuf[512] = {};
+  ring_buffer_init(&ring, ringbuf, sizeof(ringbuf));
+
+  uint8_t wr[300];
+  for (size_t i = 0; i < sizeof(wr); i++) {
+    wr[i] = i;
+  }
+  uint8_t rd[300];
+  uint32_t size = 0;
+
+  for (uint32_t round = 0; round < 10; round++) {
+    uint32_t len = 128 + round * 17;
+    ASSERT_TRUE(ring_buffer_write_record(&ring, wr, len));
+    ASSERT_EQ(len + 2, ring_buffer_used(&ring));
+    ASSERT_TRUE(ring_buffer_read_record(&ring, rd, sizeof(rd), &size));
+    ASSERT_EQ(len, size);
+    ASSERT_EQ(0, memcmp(wr, rd, len));
+  }
+
+  // Incomplete record (e.g. written by other means) is not reported
+  uint8_t header[2] = {0x80 | 44, 1};
+  ASSERT_TRUE(ring_buffer_write(&ring, header, sizeof(header)));
+  ASSERT_TRUE(ring_buffer_write(&ring, wr, 100));
+  ASSERT_FALSE(ring_buffer_next_record_size(&ring, &size));
+  ASSERT_TRUE(ring_buffer_write(&ring, wr, 72));
+  ASSERT_TRUE(ring_buffer_next_record_size(&ring, &size));
+  ASSERT_EQ(172, size);
+}
+
+TEST(ring_buffer, write_overwrite)
+{
+  struct ring_buffer ring;
+  uint8_t ringbuf[10] = {};
+  ring_buffer_init(&ring, ringbuf, sizeof(ringbuf));
+  uint8_t wr[16] = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16};
+  uint8_t rd[16] = {};
+
+  // Fits: nothing dropped
+  ring_buffer_write_overwrite(&ring, wr, 6);
+  ASSERT_EQ(6, ring_buffer_used(&ring));
+  ASSERT_EQ(0, ring.dropped);
+
+  // 2 oldest bytes dropped
+  ring_buffer_write_overwrite(&ring, &wr[6], 6);
+  ASSERT_EQ(10, ring_buffer_used(&ring));
+  ASSERT_EQ(2, ring.dropped);
+  ASSERT_TRUE(ring_buffer_read(&ring, rd, 10));
+  for (size_t i = 0; i < 10; i++) {
+    ASSERT_EQ(wr[i + 2], rd[i]) << "index " << i;
+  }
+
+  // Write larger than ring: only last bytes kept
+  ring_buffer_write_overwrite(&ring, wr, 3);
+  ring_buffer_write_overwrite(&ring, wr, 16);
+  ASSERT_EQ(2 + 3 + 6, ring.dropped);
+  ASSERT_TRUE(ring_buffer_read(&ring, rd, 10));
+  for (size_t i = 0; i < 10; i++) {
+    ASSERT_EQ(wr[i + 6], rd[i]) << "index " << i;
+  }
+  ASSERT_EQ(0, ring_buffer_used(&ring));
+}
+
+TEST(ring_buffer, write_record_overwrite)
+{
+  struct ring_buffer ring;
+  uint8_t ringbuf[16] = {};
+  ring_buffer_init(&ring, ringbuf, sizeof(ringbuf));
+  uint8_t wr[16] = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16};
+  uint8_t rd[16] = {};
+  uint32_t size;
+
+  // 3 records of 5 bytes (1 header + 4 payload): 15 bytes used
+  for (uint32_t i = 0; i < 3; i++) {
+    ASSERT_TRUE(ring_buffer_write_record_overwrite(&ring, &wr[i], 4));
+  }
+  ASSERT_EQ(15, ring_buffer_used(&ring));
+  ASSERT_EQ(0, ring.dropped);
+
+  // Next record requires dropping the first (whole) one
+  ASSERT_TRUE(ring_buffer_write_record_overwrite(&ring, &wr[3], 4));
+  ASSERT_EQ(5, ring.dropped);
+  // Larger record: drops 2 more
+  ASSERT_TRUE(ring_buffer_write_record_overwrite(&ring, &wr[4], 8));
+  ASSERT_EQ(15, ring.dropped);
+
+  // Remaining records are intact
+  ASSERT_TRUE(ring_buffer_read_record(&ring, rd, sizeof(rd), &size));
+  ASSERT_EQ(4, size);
+  ASSERT_EQ(4, rd[0]);
+  ASSERT_TRUE(ring_buffer_read_record(&ring, rd, sizeof(rd), &size));
+  ASSERT_EQ(8, size);
+  ASSERT_EQ(5, rd[0]);
+  ASSERT_EQ(0, ring_buffer_used(&ring));
+
+  // Record larger than ring never fits
+  ASSERT_FALSE(ring_buffer_write_record_overwrite(&ring, wr, 16));
+}
@@ -0,0 +1,157 @@
+// Copyright (c) Konstantin Belyalov. All rights reserved.
+// Licensed under the MIT license.
+
+#include <gtest/gtest.h>
+
+#include "ring_buffer_cobs.h"
+
+using namespace std;
+
+static vector<uint8_t> ring_read_all(struct ring_buffer* ring)
+{
+  vector<uint8_t> res(ring_buffer_used(ring));
+
+  ring_buffer_read(ring, res.data(), res.size());
+  return res;
+}
+
+static vector<uint8_t> cobs_encode(const vector<uint8_t>& data)
+{
+  uint8_t buf[1024];
+  struct ring_buffer ring;
+  ring_buffer_init(&ring, buf, sizeof(buf));
+
+  EXPECT_TRUE(ring_buffer_cobs_encode(&ring, data.data(), data.size()));
+  return ring_read_all(&ring);
+}
+
+TEST(ring_buffer_cobs, encode)
+{
+  EXPECT_EQ(vector<uint8_t>({0x01, 0x00}), cobs_encode({}));
+  EXPECT_EQ(vector<uint8_t>({0x01, 0x01, 0x00}), cobs_encode({0x00}));
+  EXPECT_EQ(vector<uint8_t>({0x01, 0x01, 0x01, 0x00}), cobs_encode({0x00, 0x00}));
+  EXPECT_EQ(vector<uint8_t>({0x03, 0x11, 0x22, 0x02, 0x33, 0x00}), cobs_encode({0x11, 0x22, 0x00, 0x33}));
+  EXPECT_EQ(vector<uint8_t>({0x02, 0x11, 0x01, 0x00}), cobs_encode({0x11, 0x00}));
+
+  // 254 non zero bytes: single full block, no extra empty block
+  vector<uint8_t> data;
+  for (size_t i = 1; i < 255; i++) {
+    data.push_back(i);
+  }
+  vector<uint8_t> encoded = cobs_encode(data);
+  ASSERT_EQ(256, encoded.size());
+  EXPECT_EQ(0xFF, encoded[0]);
+  EXPECT_EQ(0x00, encoded[255]);
+
+  // 255 bytes: second block
+  data.push_back(0xFF);
+  encoded = cobs_encode(data);
+  ASSERT_EQ(258, encoded.size());
+  EXPECT_EQ(0xFF, encoded[0]);
+  EXPECT_EQ(0x02, encoded[255]);
+  EXPECT_EQ(0xFF, encoded[256]);
+  EXPECT_EQ(0x00, encoded[257]);
+}
+
+TEST(ring_buffer_cobs, encode_no_space)
+{
+  uint8_t buf[10];
+  struct ring_buffer ring;
+  ring_buffer_init(&ring, buf, sizeof(buf));
+
+  uint8_t data[9] = {1, 2, 3, 4, 5, 6, 7, 8, 9};
+  // Worst case frame is 11 bytes: nothing written
+  ASSERT_FALSE(ring_buffer_cobs_encode(&ring, data, sizeof(data)));
+  ASSERT_EQ(0, ring_buffer_used(&ring));
+  ASSERT_TRUE(ring_buffer_cobs_encode(&ring, data, 8));
+  ASSERT_EQ(10, ring_buffer_used(&ring));
+}
+
+TEST(ring_buffer_cobs, roundtrip)
+{
+  // Sizes are chosen to make frames wrap around both rings
+  uint8_t tx_buf[700];
+  uint8_t rx_buf[600];
+  uint8_t in_buf[1000];
+  struct ring_buffer tx, rx, in;
+  ring_buffer_init(&tx, tx_buf, sizeof(tx_buf));
+  ring_buffer_init(&rx, rx_buf, sizeof(rx_buf));
+  ring_buffer_init(&in, in_buf, sizeof(in_buf));
+
+  struct ring_buffer_cobs_decoder dec;
+  ring_buffer_cobs_decoder_init(&dec, &rx);
+
+  srand(1);
+  for (size_t size = 0; size < 600; size += 7) {
+    // Payload with random amount of zeros
+    vector<uint8_t> data(size);
+    int zeros = rand() % 4;
+    for (size_t i = 0; i < size; i++) {
+      data[i] = (rand() % 4 < zeros) ? 0 : rand() % 256;
+    }
+    ASSERT_TRUE(ring_buffer_write(&in, data.data(), size));
+    ASSERT_TRUE(ring_buffer_cobs_encode_ring(&tx, &in, size));
+    ASSERT_EQ(0, ring_buffer_used(&in));
+
+    // Feed decoder in small chunks, as they come from UART
+    uint32_t len;
+    bool done = false;
+    while (ring_buffer_used(&tx) > 0) {
+      uint8_t chunk[13];
+      uint32_t n = min<uint32_t>(sizeof(chunk), ring_buffer_used(&tx));
+      ring_buffer_read(&tx, chunk, n);
+      ASSERT_TRUE(ring_buffer_write(&in, chunk, n));
+      ASSERT_FALSE(done);
+      done = ring_buffer_cobs_decode(&dec, &in, &len);
+      // Nothing is visible until frame is complete
+      if (!done) {
+        ASSERT_EQ(0, ring_buffer_used(&rx));
+      }
+    }
+    ASSERT_TRUE(done) << "size " << size;
+    ASSERT_EQ(size, len);
+    ASSERT_EQ(data, ring_read_all(&rx)) << "size " << size;
+    ASSERT_EQ(0, ring_buffer_used(&in));
+  }
+  ASSERT_EQ(0, dec.dropped);
+}
+
+TEST(ring_buffer_cobs, resync)
+{
+  uint8_t in_buf[64];
+  uint8_t rx_buf[8];
+  struct ring_buffer in, rx;
+  ring_buffer_init(&in, in_buf, sizeof(in_buf));
+  ring_buffer_init(&rx, rx_buf, sizeof(rx_buf));
+
+  struct ring_buffer_cobs_decoder dec;
+  ring_buffer_cobs_decoder_init(&dec, &rx);
+  uint32_t len;
+
+  // Truncated frame (lost bytes), then valid one
+  const uint8_t stream1[] = {0x05, 0x11, 0x22, 0x00, 0x03, 0x11, 0x22, 0x00};
+  ring_buffer_write(&in, stream1, sizeof(stream1));
+  ASSERT_TRUE(ring_buffer_cobs_decode(&dec, &in, &len));
+  ASSERT_EQ(2, len);
+  ASSERT_EQ(vector<uint8_t>({0x11, 0x22}), ring_read_all(&rx));
+  ASSERT_EQ(1, dec.dropped);
+  ASSERT_FALSE(ring_buffer_cobs_decode(&dec, &in, &len));
+
+  // Idle delimiters are ignored, frame which does not fit into rx is dropped
+  const uint8_t stream2[] = {0x00, 0x00, 0x0A, 1, 2, 3, 4, 5, 6, 7, 8, 9, 0x00, 0x02, 0x33, 0x00};
+  ring_buffer_write(&in, stream2, sizeof(stream2));
+  ASSERT_TRUE(ring_buffer_cobs_decode(&dec, &in, &len));
+  ASSERT_EQ(1, len);
+  ASSERT_EQ(vector<uint8_t>({0x33}), ring_read_all(&rx));
+  ASSERT_EQ(2, dec.dropped);
+
+  // Several frames in input: one per call
+  const uint8_t stream3[] = {0x02, 0x01, 0x00, 0x01, 0x01, 0x00};
+  ring_buffer_write(&in, stream3, sizeof(stream3));
+  ASSERT_TRUE(ring_buffer_cobs_decode(&dec, &in, &len));
+  ASSERT_EQ(1, len);
+  ASSERT_TRUE(ring_buffer_cobs_decode(&dec, &in, &len));
+  ASSERT_EQ(1, len);
+  ASSERT_EQ(vector<uint8_t>({0x01, 0x00}), ring_read_all(&rx));
+  ASSERT_FALSE(ring_buffer_cobs_decode(&dec, &in, &len));
+}
@@ -0,0 +1,97 @@
+// Copyright (c) Konstantin Belyalov. All rights reserved.
+// Licensed under the MIT license.
+
+#include <gtest/gtest.h>
+
+#include "ring_buffer_dma.h"
+
+using namespace std;
+
+// Emulates circular DMA: writes data into buffer, decrements counter
+static void dma_receive(DMA_HandleTypeDef* hdma, uint8_t* buf, uint32_t size, const string& data)
+{
+  uint32_t pos = size - hdma->counter;
+
+  for (size_t i = 0; i < data.size(); i++) {
+    buf[pos] = data[i];
+    pos = (pos + 1) % size;
+  }
+  // Counter reloads on wraparound
+  hdma->counter = size - pos;
+}
+
+static string ring_read_all(struct ring_buffer* ring)
+{
+  uint8_t tmp[64];
+  uint32_t len = ring_buffer_used(ring);
+
+  if (!ring_buffer_read(ring, tmp, len)) {
+    return "<read failed>";
+  }
+  return string((const char*)tmp, len);
+}
+
+TEST(ring_buffer_dma, receive)
+{
+  // Non power of two buffer
+  uint8_t buf[10];
+  DMA_HandleTypeDef hdma = {sizeof(buf)};
+  struct ring_buffer_dma rx;
+  ring_buffer_dma_init(&rx, &hdma, buf, sizeof(buf));
+
+  // Nothing received yet
+  ring_buffer_dma_update(&rx);
+  ASSERT_EQ(0, ring_buffer_used(&rx.ring));
+
+  // Idle line after short message
+  dma_receive(&hdma, buf, sizeof(buf), "hello");
+  ring_buffer_dma_update(&rx);
+  ASSERT_EQ(5, ring_buffer_used(&rx.ring));
+  ASSERT_EQ("hello", ring_read_all(&rx.ring));
+
+  // Complete event: DMA counter reloaded, data wrapped around buffer end
+  dma_receive(&hdma, buf, sizeof(buf), "world");
+  ASSERT_EQ(sizeof(buf), hdma.counter);
+  ring_buffer_dma_update(&rx);
+  // Spurious update does not add anything
+  ring_buffer_dma_update(&rx);
+  ASSERT_EQ(5, ring_buffer_used(&rx.ring));
+
+  // Partial read, then some more data across buffer end
+  uint8_t tmp[3];
+  ASSERT_TRUE(ring_buffer_read(&rx.ring, tmp, sizeof(tmp)));
+  ASSERT_EQ("wor", string((const char*)tmp, sizeof(tmp)));
+  dma_receive(&hdma, buf, sizeof(buf), "1234567");
+  ring_buffer_dma_update(&rx);
+  ASSERT_EQ("ld1234567", ring_read_all(&rx.ring));
+  ASSERT_EQ(0, rx.ring.dropped);
+}
+
+TEST(ring_buffer_dma, overrun)
+{
+  // Power of two buffer: masked mode
+  uint8_t buf[8];
+  DMA_HandleTypeDef hdma = {sizeof(buf)};
+  struct ring_buffer_dma rx;
+  ring_buffer_dma_init(&rx, &hdma, buf, sizeof(buf));
+
+  // Half transfer / complete events, nobody reads data
+  dma_receive(&hdma, buf, sizeof(buf), "abcd");
+  ring_buffer_dma_update(&rx);
+  dma_receive(&hdma, buf, sizeof(buf), "efgh");
+  ring_buffer_dma_update(&rx);
+  ASSERT_EQ(8, ring_buffer_used(&rx.ring));
+  ASSERT_EQ(0, rx.ring.dropped);
+
+  // DMA overwrites the oldest data
+  dma_receive(&hdma, buf, sizeof(buf), "ijk");
+  ring_buffer_dma_update(&rx);
+  ASSERT_EQ(3, rx.ring.dropped);
+  ASSERT_EQ("defghijk", ring_read_all(&rx.ring));
+
+  // Works normally after overrun
+  dma_receive(&hdma, buf, sizeof(buf), "lmnop");
+  ring_buffer_dma_update(&rx);
+  ASSERT_EQ("lmnop", ring_read_all(&rx.ring));
+  ASSERT_EQ(3, rx.ring.dropped);
+}
@@ -92,6 +92,8 @@ TEST(ring_buffer_fixed_size, push_override)
     }
   }
 
+  ASSERT_EQ(10, RING_BUFFER_DROPPED(rbuf));
+
   // Pop all items (expect only last 10)
   for (uint32_t i = 0; i < 10; i++) {
     struct item *i_pop = RING_BUFFER_POP(rbuf);
@@ -100,3 +102,136 @@ TEST(ring_buffer_fixed_size, push_override)
     ASSERT_FALSE(RING_BUFFER_FULL(rbuf));
   }
 }
+
+TEST(ring_buffer_fixed_size, push_override_partial)
+{
+  // Create ring buffer of 10 items
+  RING_BUFFER_DECLARE(rbuf, struct item, 10);
+  RING_BUFFER_DEFINE(rbuf, struct item, 10);
+
+  // Overflow by 1 item: only the oldest one must be lost
+  for (uint32_t i = 0; i < 11; i++) {
+    struct item i_pushed = {i, i};
+    RING_BUFFER_PUSH_COPY(rbuf, &i_pushed);
+  }
+  ASSERT_TRUE(RING_BUFFER_FULL(rbuf));
+  ASSERT_EQ(1, RING_BUFFER_DROPPED(rbuf));
+
+  for (uint32_t i = 1; i < 11; i++) {
+    ASSERT_FALSE(RING_BUFFER_EMPTY(rbuf));
+    struct item *i_pop = RING_BUFFER_POP(rbuf);
+    ASSERT_EQ(i, i_pop->a);
+  }
+  ASSERT_TRUE(RING_BUFFER_EMPTY(rbuf));
+}
+
+TEST(ring_buffer_fixed_size, pow2)
+{
+  // Power of two capacity: free running indexes, bitmask wraparound
+  RING_BUFFER_DECLARE(rbuf, struct item, 8);
+  RING_BUFFER_DEFINE(rbuf, struct item, 8);
+  ASSERT_EQ(8, RING_BUFFER_CAPACITY(rbuf));
+
+  // Several rounds of fill / drain to roll indexes over buffer end
+  for (uint32_t round = 0; round < 5; round++) {
+    for (uint32_t i = 0; i < 5; i++) {
+      struct item i_pushed = {round, i};
+      RING_BUFFER_PUSH_COPY(rbuf, &i_pushed);
+    }
+    ASSERT_FALSE(RING_BUFFER_FULL(rbuf));
+    for (uint32_t i = 0; i < 5; i++) {
+      ASSERT_FALSE(RING_BUFFER_EMPTY(rbuf));
+      struct item *i_pop = RING_BUFFER_POP(rbuf);
+      ASSERT_EQ(round, i_pop->a);
+      ASSERT_EQ(i, i_pop->b);
+    }
+    ASSERT_TRUE(RING_BUFFER_EMPTY(rbuf));
+  }
+
+  // Overflow: keep last 8 out of 13
+  for (uint32_t i = 0; i < 13; i++) {
+    struct item i_pushed = {i, 0};
+    RING_BUFFER_PUSH_COPY(rbuf, &i_pushed);
+  }
+  ASSERT_TRUE(RING_BUFFER_FULL(rbuf));
+  for (uint32_t i = 5; i < 13; i++) {
+    struct item *i_pop = RING_BUFFER_POP(rbuf);
+    ASSERT_EQ(i, i_pop->a);
+  }
+  ASSERT_TRUE(RING_BUFFER_EMPTY(rbuf));
+}
+
+TEST(ring_buffer_fixed_size, count_free)
+{
+  RING_BUFFER_DECLARE(rbuf, struct item, 10);
+  RING_BUFFER_DEFINE(rbuf, struct item, 10);
+  ASSERT_EQ(0, RING_BUFFER_COUNT(rbuf));
+  ASSERT_EQ(10, RING_BUFFER_FREE(rbuf));
+
+  for (uint32_t i = 0; i < 25; i++) {
+    struct item i_pushed = {i, i};
+    RING_BUFFER_PUSH_COPY(rbuf, &i_pushed);
+    size_t expected = i < 10 ? i + 1 : 10;
+    ASSERT_EQ(expected, RING_BUFFER_COUNT(rbuf));
+    ASSERT_EQ(10 - expected, RING_BUFFER_FREE(rbuf));
+  }
+  for (uint32_t i = 0; i < 10; i++) {
+    RING_BUFFER_POP(rbuf);
+    ASSERT_EQ(9 - i, RING_BUFFER_COUNT(rbuf));
+  }
+}
+
+template <typename Ring>
+static void bulk_rounds(Ring* rbuf)
+{
+  struct item in[40];
+  struct item out[40];
+  for (uint32_t i = 0; i < 40; i++) {
+    in[i] = {i, i * 10};
+  }
+  size_t capacity = RING_BUFFER_CAPACITY(rbuf);
+
+  // Push / pop different amounts to roll over buffer end
+  for (size_t round = 0; round < 3 * capacity; round++) {
+    size_t count = round % capacity + 1;
+    ASSERT_EQ(count, RING_BUFFER_PUSH_BULK(rbuf, &in[round % 10], count));
+    ASSERT_EQ(count, RING_BUFFER_COUNT(rbuf));
+    // Pop less than available, then the rest
+    size_t first = count / 2;
+    ASSERT_EQ(first, RING_BUFFER_POP_BULK(rbuf, out, first));
+    ASSERT_EQ(count - first, RING_BUFFER_POP_BULK(rbuf, &out[first], 40));
+    for (size_t i = 0; i < count; i++) {
+      ASSERT_EQ(in[round % 10 + i].a, out[i].a) << "round " << round << " index " << i;
+      ASSERT_EQ(in[round % 10 + i].b, out[i].b);
+    }
+    ASSERT_TRUE(RING_BUFFER_EMPTY(rbuf));
+  }
+  ASSERT_EQ(0, RING_BUFFER_DROPPED(rbuf));
+
+  // Overflow: partially, then more than capacity at once
+  RING_BUFFER_PUSH_BULK(rbuf, in, capacity - 2);
+  RING_BUFFER_PUSH_BULK(rbuf, &in[capacity - 2], 5);
+  ASSERT_EQ(3, RING_BUFFER_DROPPED(rbuf));
+  ASSERT_EQ(capacity, RING_BUFFER_POP_BULK(rbuf, out, 40));
+  for (size_t i = 0; i < capacity; i++) {
+    ASSERT_EQ(i + 3, out[i].a);
+  }
+  ASSERT_EQ(capacity, RING_BUFFER_PUSH_BULK(rbuf, in, capacity + 7));
+  ASSERT_EQ(3 + 7, RING_BUFFER_DROPPED(rbuf));
+  ASSERT_EQ(capacity, RING_BUFFER_POP_BULK(rbuf, out, 40));
+  for (size_t i = 0; i < capacity; i++) {
+    ASSERT_EQ(i + 7, out[i].a);
+  }
+  ASSERT_EQ(0, RING_BUFFER_POP_BULK(rbuf, out, 1));
+}
+
+TEST(ring_buffer_fixed_size, bulk)
+{
+  RING_BUFFER_DECLARE(rbuf, struct item, 10);
+  RING_BUFFER_DEFINE(rbuf, struct item, 10);
+  bulk_rounds(rbuf);
+
+  RING_BUFFER_DECLARE(rbuf2, struct item, 16);
+  RING_BUFFER_DEFINE(rbuf2, struct item, 16);
+  bulk_rounds(rbuf2);
+}
@@ -0,0 +1,144 @@
+// Copyright (c) Konstantin Belyalov. All rights reserved.
+// Licensed under the MIT license.
+
+#include <gtest/gtest.h>
+#include <memory>
+#include <vector>
+
+#include "ring_buffer_fixed_size.hpp"
+
+using namespace std;
+
+template <size_t N>
+static void push_pop_rounds()
+{
+  ring_buffer_fixed_size<uint32_t, N> ring;
+  ASSERT_EQ(N, ring.capacity());
+  ASSERT_TRUE(ring.empty());
+
+  // Several fill / drain rounds to roll indexes over buffer end multiple times
+  uint32_t value = 0;
+  uint32_t expected = 0;
+  for (size_t round = 0; round < 3 * N; round++) {
+    size_t count = round % N + 1;
+    for (size_t i = 0; i < count; i++) {
+      ASSERT_TRUE(ring.push(value++));
+    }
+    ASSERT_EQ(count, ring.size());
+    ASSERT_EQ(N - count, ring.free());
+    ASSERT_EQ(count == N, ring.full());
+    ASSERT_EQ(value - 1, ring.back());
+    for (size_t i = 0; i < count; i++) {
+      uint32_t item;
+      ASSERT_TRUE(ring.pop(item));
+      ASSERT_EQ(expected++, item);
+    }
+    ASSERT_TRUE(ring.empty());
+  }
+}
+
+TEST(ring_buffer_fixed_size_cpp, push_pop)
+{
+  push_pop_rounds<10>();
+  push_pop_rounds<8>();
+  push_pop_rounds<1>();
+}
+
+TEST(ring_buffer_fixed_size_cpp, full_empty)
+{
+  ring_buffer_fixed_size<int, 3> ring;
+  int item;
+
+  ASSERT_FALSE(ring.pop(item));
+  ASSERT_TRUE(ring.push(1));
+  ASSERT_TRUE(ring.push(2));
+  ASSERT_TRUE(ring.push(3));
+  ASSERT_TRUE(ring.full());
+  ASSERT_FALSE(ring.push(4));
+  ASSERT_EQ(1, ring.front());
+
+  // Overwrite oldest
+  ring.push_overwrite(4);
+  ASSERT_TRUE(ring.full());
+  ASSERT_EQ(2, ring.front());
+  ASSERT_EQ(4, ring.back());
+
+  ring.pop();
+  ASSERT_EQ(3, ring.front());
+  ring.clear();
+  ASSERT_TRUE(ring.empty());
+}
+
+TEST(ring_buffer_fixed_size_cpp, bulk)
+{
+  ring_buffer_fixed_size<uint16_t, 16> ring;
+  uint16_t in[32];
+  uint16_t out[32];
+  for (size_t i = 0; i < 32; i++) {
+    in[i] = i;
+  }
+
+  // Bulk push is limited by free space
+  ASSERT_EQ(10, ring.push_bulk(in, 10));
+  ASSERT_EQ(6, ring.push_bulk(in + 10, 20));
+  ASSERT_TRUE(ring.full());
+  ASSERT_EQ(0, ring.push_bulk(in, 1));
+
+  // Bulk pop, then bulk push which rolls over buffer end
+  ASSERT_EQ(12, ring.pop_bulk(out, 12));
+  for (size_t i = 0; i < 12; i++) {
+    ASSERT_EQ(i, out[i]);
+  }
+  ASSERT_EQ(10, ring.push_bulk(in + 16, 10));
+  ASSERT_EQ(14, ring.pop_bulk(out, 32));
+  for (size_t i = 0; i < 14; i++) {
+    ASSERT_EQ(i + 12, out[i]);
+  }
+  ASSERT_TRUE(ring.empty());
+  ASSERT_EQ(0, ring.pop_bulk(out, 1));
+}
+
+TEST(ring_buffer_fixed_size_cpp, move_only)
+{
+  ring_buffer_fixed_size<unique_ptr<int>, 4> ring;
+
+  ASSERT_TRUE(ring.push(unique_ptr<int>(new int(1))));
+  unique_ptr<int> items[3];
+  for (int i = 0; i < 3; i++) {
+    items[i].reset(new int(i + 2));
+  }
+  ASSERT_EQ(3, ring.push_bulk(items, 3));
+  // Items were moved into ring
+  ASSERT_FALSE(items[0]);
+
+  unique_ptr<int> p;
+  ASSERT_TRUE(ring.pop(p));
+  ASSERT_EQ(1, *p);
+  ASSERT_EQ(3, ring.pop_bulk(items, 3));
+  for (int i = 0; i < 3; i++) {
+    ASSERT_EQ(i + 2, *items[i]);
+  }
+}
+
+TEST(ring_buffer_fixed_size_cpp, iterators)
+{
+  ring_buffer_fixed_size<int, 5> ring;
+  ASSERT_TRUE(ring.begin() == ring.end());
+
+  // Make live elements roll over buffer end
+  for (int i = 0; i < 8; i++) {
+    ring.push_overwrite(i);
+  }
+  vector<int> items(ring.begin(), ring.end());
+  ASSERT_EQ(vector<int>({3, 4, 5, 6, 7}), items);
+
+  for (auto& item : ring) {
+    item *= 10;
+  }
+  const ring_buffer_fixed_size<int, 5>& cring = ring;
+  int expected = 30;
+  for (auto it = cring.begin(); it != cring.end(); ++it) {
+    ASSERT_EQ(expected, *it);
+    expected += 10;
+  }
+}
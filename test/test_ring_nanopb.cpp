@@ -2,8 +2,10 @@
 // Licensed under the MIT license.
 
 #include <gtest/gtest.h>
+#include <string.h>
 
 #include "ring_buffer_nanopb.h"
+#include "ring_buffer_cobs.h"
 #include "pb_encode.h"
 #include "pb_decode.h"
 
@@ -11,61 +13,6 @@
 
 using namespace std;
 
-TEST(ring_buffer_nanopb, setters_getters) {
-  struct ring_buffer_metadata meta = {};
-  meta.size = 10;
-
-  // No data
-  meta.tail = 5;
-  meta.head = 5;
-  ASSERT_EQ(pb_ring_buffer_metadata_used(&meta), 0);
-  ASSERT_EQ(pb_ring_buffer_metadata_free(&meta), 10);
-
-  // Emulate that buffer just got 2 bytes
-  // **--------
-  // T H
-  meta.tail = 0;
-  meta.head = 2;
-  ASSERT_EQ(pb_ring_buffer_metadata_used(&meta), 2);
-  ASSERT_EQ(pb_ring_buffer_metadata_free(&meta), 8);
-
-  // "Read" 2 bytes
-  meta.tail = 2;
-  ASSERT_EQ(pb_ring_buffer_metadata_used(&meta), 0);
-  ASSERT_EQ(pb_ring_buffer_metadata_free(&meta), 10);
-
-  // Right edge: last 8 bytes used, head rolled over
-  // --********
-  // H T
-  meta.head = 0;
-  ASSERT_EQ(pb_ring_buffer_metadata_used(&meta), 8);
-  ASSERT_EQ(pb_ring_buffer_metadata_free(&meta), 2);
-
-  // Rolled over buffer:
-  // **--******
-  //   H T
-  meta.tail = 4;
-  meta.head = 2;
-  ASSERT_EQ(pb_ring_buffer_metadata_used(&meta), 8);
-  ASSERT_EQ(pb_ring_buffer_metadata_free(&meta), 2);
-
-  // Advance tail
-  meta.tail = 0;
-  meta.head = 0;
-  pb_ring_buffer_advance_tail(&meta, 5);
-  ASSERT_EQ(meta.tail, 5);
-  pb_ring_buffer_advance_tail(&meta, 5);
-  ASSERT_EQ(meta.tail, 0);
-
-  // Advance head
-  meta.tail = 0;
-  meta.head = 0;
-  pb_ring_buffer_advance_head(&meta, 5);
-  ASSERT_EQ(meta.head, 5);
-  pb_ring_buffer_advance_head(&meta, 5);
-  ASSERT_EQ(meta.head, 0);
-}
-
 TEST(ring_buffer_nanopb, read_callback)
 {
   // Init some test buffer
@@ -74,84 +21,110 @@ TEST(ring_buffer_nanopb, read_callback)
     buf[i] = i;
   }
 
-  struct ring_buffer_metadata meta = {};
-  meta.buf = buf;
-  meta.size = sizeof(buf);
-  pb_istream_t stream = pb_istream_from_ring_buffer(&meta, 0);
+  struct ring_buffer ring;
+  ring_buffer_init(&ring, buf, sizeof(buf));
+
+  // Buffer rollover use case (8 bytes: 6 by the end and 2 from the beginning)
+  // **--******
+  ring_buffer_advance_head(&ring, 4);
+  ring_buffer_read_consume(&ring, 4);
+  ring_buffer_advance_head(&ring, 8);
 
-  // "Put" some data into buffer
-  meta.head = 6;
+  // Wrapped message is read through callback
+  pb_istream_t stream = pb_istream_from_ring_buffer(&ring, 8);
+  ASSERT_EQ(&ring, stream.state);
 
-  // "Read" 5 bytes of 6 total in buffer
+  // "Read" 5 bytes
   {
     uint8_t test[5];
-    bool res = stream.callback(&stream, test, sizeof(test));
-    // Verify data
+    bool res = pb_read(&stream, test, sizeof(test));
     ASSERT_TRUE(res);
     for (size_t i = 0; i < sizeof(test); i++) {
-      ASSERT_EQ(test[i], i) << "index " << i;
+      ASSERT_EQ(test[i], (i + 4) % 10) << "index " << i;
     }
   }
-  // "Read" last byte
+  // The rest, across buffer end
   {
-    uint8_t test;
-    bool res = stream.callback(&stream, &test, 1);
+    uint8_t test[3];
+    bool res = pb_read(&stream, test, sizeof(test));
     ASSERT_TRUE(res);
-    ASSERT_EQ(test, 5);
+    for (size_t i = 0; i < sizeof(test); i++) {
+      ASSERT_EQ(test[i], (i + 9) % 10) << "index " << i;
+    }
   }
+  ASSERT_EQ(0, ring_buffer_used(&ring));
+
   // Ensure that callback will fail when there is no more data
   ASSERT_FALSE(stream.callback(&stream, NULL, 1));
+}
 
-  // Buffer rollover use case (8 bytes: 6 by the end and 2 from the beginning)
-  // **--******
-  meta.tail = 4;
-  meta.head = 2;
+TEST(ring_buffer_nanopb, read_contiguous)
+{
+  uint8_t buf[10];
+  for (size_t i = 0; i < sizeof(buf); i++) {
+    buf[i] = i;
+  }
+
+  struct ring_buffer ring;
+  ring_buffer_init(&ring, buf, sizeof(buf));
+  ring_buffer_advance_head(&ring, 6);
+
+  // Contiguous message is read through callback as well: nothing is
+  // released from ring until it is read
+  pb_istream_t stream = pb_istream_from_ring_buffer(&ring, 5);
+  ASSERT_EQ(&ring, stream.state);
+  ASSERT_EQ(6, ring_buffer_used(&ring));
 
-  uint8_t test[8];
-  bool res = stream.callback(&stream, test, sizeof(test));
-  // Verify data
-  ASSERT_TRUE(res);
+  uint8_t test[5];
+  ASSERT_TRUE(pb_read(&stream, test, 2));
+  ASSERT_EQ(4, ring_buffer_used(&ring));
+  ASSERT_TRUE(pb_read(&stream, &test[2], 3));
   for (size_t i = 0; i < sizeof(test); i++) {
-    ASSERT_EQ(test[i], (i + 4) % 10);
+    ASSERT_EQ(test[i], i) << "index " << i;
   }
+  ASSERT_EQ(1, ring_buffer_used(&ring));
+  ASSERT_FALSE(pb_read(&stream, test, 1));
 }
 
 TEST(ring_buffer_nanopb, write_callback)
 {
   uint8_t buf[6] = {};
-  struct ring_buffer_metadata meta = {};
-  meta.buf = buf;
-  meta.size = sizeof(buf);
-  pb_ostream_t stream = pb_ostream_from_ring_buffer(&meta);
+  struct ring_buffer ring;
+  ring_buffer_init(&ring, buf, sizeof(buf));
+  pb_ostream_t stream = pb_ostream_from_ring_buffer(&ring);
 
   // write some data
   uint8_t tmp[4] = {1, 2, 3, 4};
-  stream.callback(&stream, tmp, sizeof(tmp));
+  ASSERT_TRUE(stream.callback(&stream, tmp, sizeof(tmp)));
   // verify that it has been written well
-  ASSERT_EQ(pb_ring_buffer_metadata_used(&meta), 4);
+  ASSERT_EQ(4, ring_buffer_used(&ring));
   for (size_t i = 0; i < sizeof(tmp); i++) {
     ASSERT_EQ(buf[i], tmp[i]);
   }
 
   // "read" it
-  meta.tail = meta.head;
+  ring_buffer_read_consume(&ring, 4);
 
   // write it again: this will cause buffer to rollover
-  stream.callback(&stream, tmp, sizeof(tmp));
-  ASSERT_EQ(pb_ring_buffer_metadata_used(&meta), 4);
+  ASSERT_TRUE(stream.callback(&stream, tmp, sizeof(tmp)));
+  ASSERT_EQ(4, ring_buffer_used(&ring));
   // verity it one more time: part of data should be rolled over
   ASSERT_EQ(buf[4], tmp[0]);
   ASSERT_EQ(buf[5], tmp[1]);
   ASSERT_EQ(buf[0], tmp[2]);
   ASSERT_EQ(buf[1], tmp[3]);
+
+  // Whole buffer capacity is usable
+  ASSERT_TRUE(stream.callback(&stream, tmp, 2));
+  ASSERT_EQ(6, ring_buffer_used(&ring));
+  ASSERT_FALSE(stream.callback(&stream, tmp, 1));
 }
 
 TEST(ring_buffer_nanopb, encode_decode)
 {
   uint8_t buf[32];
-  struct ring_buffer_metadata meta = {};
-  meta.buf = buf;
-  meta.size = sizeof(buf);
+  struct ring_buffer ring;
+  ring_buffer_init(&ring, buf, sizeof(buf));
 
   protobufs_Test msg = protobufs_Test_init_default;
   msg.foo = 1;
@@ -166,16 +139,17 @@ TEST(ring_buffer_nanopb, encode_decode)
   // it will effectively trigger buffer roll over from time to time
   for (size_t i = 0; i < 20; i++) {
     // Encode message into ring buffer
-    pb_ostream_t ostream = pb_ostream_from_ring_buffer(&meta);
+    pb_ostream_t ostream = pb_ostream_from_ring_buffer(&ring);
     bool res = pb_encode(&ostream, protobufs_Test_fields, &msg);
     ASSERT_TRUE(res);
 
     // Then decode it back
     protobufs_Test msg2 = protobufs_Test_init_default;
-    pb_istream_t istream = pb_istream_from_ring_buffer(&meta, ostream.bytes_written);
+    pb_istream_t istream = pb_istream_from_ring_buffer(&ring, ostream.bytes_written);
 
     res = pb_decode(&istream, protobufs_Test_fields, &msg2);
     ASSERT_TRUE(res);
+    ASSERT_EQ(0, ring_buffer_used(&ring));
 
     // Verify that messages match
     ASSERT_EQ(msg.foo, msg2.foo);
@@ -186,3 +160,416 @@ TEST(ring_buffer_nanopb, encode_decode)
     ASSERT_EQ(msg.sub.sub_bar, msg2.sub.sub_bar);
   }
 }
+
+static void fill_test_msg(protobufs_Test* msg)
+{
+  *msg = protobufs_Test_init_default;
+  msg->foo = 1;
+  msg->bar = 2;
+  msg->baz = true;
+  msg->has_sub = true;
+  msg->sub.sub_foo = 3;
+  msg->sub.sub_bar = 4;
+}
+
+TEST(ring_buffer_nanopb, encode_transaction)
+{
+  uint8_t buf[16];
+  struct ring_buffer ring;
+  ring_buffer_init(&ring, buf, sizeof(buf));
+
+  protobufs_Test msg;
+  fill_test_msg(&msg);
+  size_t msg_len;
+  ASSERT_TRUE(pb_get_encoded_size(&msg_len, protobufs_Test_fields, &msg));
+  ASSERT_LT(msg_len, sizeof(buf));
+
+  // Does not fit: ring must remain untouched
+  ring_buffer_advance_head(&ring, sizeof(buf) - msg_len + 1);
+  uint32_t head = ring.head;
+  ASSERT_FALSE(pb_encode_to_ring_buffer(&ring, protobufs_Test_fields, &msg));
+  ASSERT_EQ(head, ring.head);
+  ASSERT_EQ(sizeof(buf) - msg_len + 1, ring_buffer_used(&ring));
+
+  // Free some space: message fits now (wrapped around buffer end)
+  ring_buffer_read_consume(&ring, ring_buffer_used(&ring));
+  ASSERT_TRUE(pb_encode_to_ring_buffer(&ring, protobufs_Test_fields, &msg));
+  ASSERT_EQ(msg_len, ring_buffer_used(&ring));
+
+  protobufs_Test msg2 = protobufs_Test_init_default;
+  pb_istream_t istream = pb_istream_from_ring_buffer(&ring, msg_len);
+  ASSERT_TRUE(pb_decode(&istream, protobufs_Test_fields, &msg2));
+  ASSERT_EQ(msg.foo, msg2.foo);
+  ASSERT_EQ(msg.sub.sub_bar, msg2.sub.sub_bar);
+  ASSERT_EQ(0, ring_buffer_used(&ring));
+}
+
+// Encodes 4 bytes long "data" (8 bytes on "grow_on" call), then fails when
+// it is "fail_on" call. Call 1 is sizing pass of pb_encode_to_ring_buffer().
+struct encode_callback_state {
+  uint32_t calls;
+  uint32_t fail_on;
+  uint32_t grow_on;
+};
+
+static bool encode_data_callback(pb_ostream_t* stream, const pb_field_t* field, void* const* arg)
+{
+  struct encode_callback_state* state = (struct encode_callback_state*)*arg;
+  static const uint8_t data[8] = {1, 2, 3, 4, 5, 6, 7, 8};
+
+  state->calls++;
+  size_t len = state->calls == state->grow_on ? sizeof(data) : 4;
+  if (!pb_encode_tag_for_field(stream, field) || !pb_encode_string(stream, data, len)) {
+    return false;
+  }
+  return state->calls != state->fail_on;
+}
+
+TEST(ring_buffer_nanopb, encode_transaction_rollback)
+{
+  uint8_t buf[64];
+  struct ring_buffer ring;
+  ring_buffer_init(&ring, buf, sizeof(buf));
+  // Committed message right before buffer end: reserved area wraps
+  ring_buffer_advance_head(&ring, 50);
+  ring_buffer_read_consume(&ring, 50);
+  protobufs_Test msg;
+  fill_test_msg(&msg);
+  ASSERT_TRUE(pb_encode_to_ring_buffer(&ring, protobufs_Test_fields, &msg));
+  uint32_t head = ring.head;
+  uint32_t used = ring_buffer_used(&ring);
+  struct ring_buffer_span spans[2];
+  ASSERT_EQ(used, ring_buffer_read_peek(&ring, used, spans));
+  ASSERT_NE(0, spans[1].len);
+  uint8_t committed[sizeof(buf)];
+  memcpy(committed, spans[0].buf, spans[0].len);
+  memcpy(&committed[spans[0].len], spans[1].buf, spans[1].len);
+
+  // Space is reserved, encode fails half way (after "foo" and part of "data"
+  // are written into reserved area) or encodes more than sizing pass said
+  struct encode_callback_state states[] = {
+    {0, 2, 0},
+    {0, 0, 2},
+  };
+  for (size_t i = 0; i < sizeof(states) / sizeof(states[0]); i++) {
+    protobufs_CallbackTest cmsg = protobufs_CallbackTest_init_default;
+    cmsg.foo = 100;
+    cmsg.data.funcs.encode = &encode_data_callback;
+    cmsg.data.arg = &states[i];
+    ASSERT_FALSE(pb_encode_to_ring_buffer(&ring, protobufs_CallbackTest_fields, &cmsg)) << "case " << i;
+    ASSERT_EQ(2, states[i].calls) << "case " << i;
+    // Rolled back: nothing is published, committed data is intact
+    ASSERT_EQ(head, ring.head) << "case " << i;
+    ASSERT_EQ(used, ring_buffer_used(&ring)) << "case " << i;
+    ASSERT_EQ(used, ring_buffer_read_peek(&ring, used, spans));
+    ASSERT_EQ(0, memcmp(committed, spans[0].buf, spans[0].len)) << "case " << i;
+    ASSERT_EQ(0, memcmp(&committed[spans[0].len], spans[1].buf, spans[1].len)) << "case " << i;
+  }
+
+  // Ring is still usable: committed message first, then the next one
+  struct encode_callback_state ok = {0, 0, 0};
+  protobufs_CallbackTest cmsg = protobufs_CallbackTest_init_default;
+  cmsg.foo = 100;
+  cmsg.data.funcs.encode = &encode_data_callback;
+  cmsg.data.arg = &ok;
+  ASSERT_TRUE(pb_encode_to_ring_buffer(&ring, protobufs_CallbackTest_fields, &cmsg));
+
+  protobufs_Test msg2 = protobufs_Test_init_default;
+  ASSERT_TRUE(pb_decode_from_ring_buffer(&ring, used, protobufs_Test_fields, &msg2));
+  ASSERT_EQ(msg.foo, msg2.foo);
+  ASSERT_EQ(msg.sub.sub_bar, msg2.sub.sub_bar);
+  protobufs_CallbackTest cmsg2 = protobufs_CallbackTest_init_default;
+  ASSERT_TRUE(pb_decode_from_ring_buffer(&ring, ring_buffer_used(&ring), protobufs_CallbackTest_fields, &cmsg2));
+  ASSERT_EQ(100, cmsg2.foo);
+}
+
+TEST(ring_buffer_nanopb, encode_delimited)
+{
+  uint8_t buf[40];
+  struct ring_buffer ring;
+  ring_buffer_init(&ring, buf, sizeof(buf));
+
+  protobufs_Test msg;
+  fill_test_msg(&msg);
+
+  // No message yet
+  pb_istream_t istream;
+  ASSERT_FALSE(pb_istream_from_ring_buffer_delimited(&ring, &istream));
+
+  for (int32_t i = 0; i < 20; i++) {
+    msg.foo = i;
+    ASSERT_TRUE(pb_encode_delimited_to_ring_buffer(&ring, protobufs_Test_fields, &msg));
+
+    protobufs_Test msg2 = protobufs_Test_init_default;
+    ASSERT_TRUE(pb_istream_from_ring_buffer_delimited(&ring, &istream));
+    ASSERT_TRUE(pb_decode(&istream, protobufs_Test_fields, &msg2));
+    ASSERT_EQ(i, msg2.foo);
+    ASSERT_EQ(msg.sub.sub_foo, msg2.sub.sub_foo);
+    ASSERT_EQ(0, ring_buffer_used(&ring));
+  }
+
+  // Delimited message is regular ring_buffer record
+  ASSERT_TRUE(pb_encode_delimited_to_ring_buffer(&ring, protobufs_Test_fields, &msg));
+  uint8_t record[40];
+  uint32_t record_size;
+  ASSERT_TRUE(ring_buffer_read_record(&ring, record, sizeof(record), &record_size));
+  size_t msg_len;
+  ASSERT_TRUE(pb_get_encoded_size(&msg_len, protobufs_Test_fields, &msg));
+  ASSERT_EQ(msg_len, record_size);
+}
+
+TEST(ring_buffer_nanopb, decode_zero_copy)
+{
+  protobufs_Test msg;
+  fill_test_msg(&msg);
+  size_t msg_len;
+  ASSERT_TRUE(pb_get_encoded_size(&msg_len, protobufs_Test_fields, &msg));
+
+  // Buffer fits 2 messages (and a bit more): contiguous and wrapped ones
+  uint8_t buf[protobufs_Test_size * 2 + 3];
+  struct ring_buffer ring;
+  ring_buffer_init(&ring, buf, msg_len * 2 + 3);
+
+  // Incomplete message: ring untouched
+  protobufs_Test msg2;
+  ASSERT_TRUE(pb_encode_to_ring_buffer(&ring, protobufs_Test_fields, &msg));
+  ASSERT_FALSE(pb_decode_from_ring_buffer(&ring, msg_len + 1, protobufs_Test_fields, &msg2));
+  ASSERT_EQ(msg_len, ring_buffer_used(&ring));
+
+  for (int32_t i = 0; i < 20; i++) {
+    msg.foo = i + 1;
+    ASSERT_TRUE(pb_encode_to_ring_buffer(&ring, protobufs_Test_fields, &msg));
+    msg2 = protobufs_Test_init_default;
+    ASSERT_TRUE(pb_decode_from_ring_buffer(&ring, msg_len, protobufs_Test_fields, &msg2));
+    ASSERT_EQ(i > 0 ? i : 1, msg2.foo);
+    ASSERT_EQ(msg.sub.sub_bar, msg2.sub.sub_bar);
+    // Only decoded message is released
+    ASSERT_EQ(msg_len, ring_buffer_used(&ring));
+  }
+
+  // Delimited
+  ring_buffer_reset(&ring);
+  ASSERT_FALSE(pb_decode_delimited_from_ring_buffer(&ring, protobufs_Test_fields, &msg2));
+  for (int32_t i = 0; i < 20; i++) {
+    msg.foo = i;
+    ASSERT_TRUE(pb_encode_delimited_to_ring_buffer(&ring, protobufs_Test_fields, &msg));
+    msg2 = protobufs_Test_init_default;
+    ASSERT_TRUE(pb_decode_delimited_from_ring_buffer(&ring, protobufs_Test_fields, &msg2));
+    ASSERT_EQ(i, msg2.foo);
+    ASSERT_EQ(msg.sub.sub_foo, msg2.sub.sub_foo);
+    ASSERT_EQ(0, ring_buffer_used(&ring));
+  }
+
+  // Malformed message is dropped
+  uint8_t junk[] = {0xff, 0xff, 0xff};
+  ASSERT_TRUE(ring_buffer_write(&ring, junk, sizeof(junk)));
+  ASSERT_FALSE(pb_decode_from_ring_buffer(&ring, sizeof(junk), protobufs_Test_fields, &msg2));
+  ASSERT_EQ(0, ring_buffer_used(&ring));
+  ASSERT_EQ(sizeof(junk), ring.dropped);
+}
+
+TEST(ring_buffer_nanopb, batch)
+{
+  uint8_t buf[100];
+  struct ring_buffer ring;
+  ring_buffer_init(&ring, buf, sizeof(buf));
+
+  protobufs_Test msgs[8];
+  for (size_t i = 0; i < 8; i++) {
+    fill_test_msg(&msgs[i]);
+    msgs[i].foo = i + 1;
+  }
+  size_t msg_len;
+  ASSERT_TRUE(pb_get_encoded_size(&msg_len, protobufs_Test_fields, &msgs[0]));
+  // Length prefix is 1 byte
+  size_t fits = sizeof(buf) / (msg_len + 1);
+  ASSERT_LT(fits, 8);
+
+  // Only whole messages which fit are written
+  ASSERT_EQ(fits, pb_encode_batch_to_ring_buffer(&ring, protobufs_Test_fields, msgs, sizeof(msgs[0]), 8));
+  ASSERT_EQ(fits * (msg_len + 1), ring_buffer_used(&ring));
+
+  // Messages are regular delimited messages
+  protobufs_Test out[8];
+  pb_istream_t istream;
+  ASSERT_TRUE(pb_istream_from_ring_buffer_delimited(&ring, &istream));
+  ASSERT_TRUE(pb_decode(&istream, protobufs_Test_fields, &out[0]));
+  ASSERT_EQ(1, out[0].foo);
+
+  // Decode part of the rest
+  ASSERT_EQ(2, pb_decode_batch_from_ring_buffer(&ring, protobufs_Test_fields, out, sizeof(out[0]), 2));
+  ASSERT_EQ(2, out[0].foo);
+  ASSERT_EQ(3, out[1].foo);
+  ASSERT_EQ((fits - 3) * (msg_len + 1), ring_buffer_used(&ring));
+
+  // Encode / decode several times: batch wraps around buffer end
+  for (size_t round = 0; round < 10; round++) {
+    size_t used = ring_buffer_used(&ring) / (msg_len + 1);
+    size_t encoded = pb_encode_batch_to_ring_buffer(&ring, protobufs_Test_fields, msgs, sizeof(msgs[0]), 3);
+    ASSERT_EQ(3, encoded);
+    ASSERT_EQ(used + 3, pb_decode_batch_from_ring_buffer(&ring, protobufs_Test_fields, out, sizeof(out[0]), 8));
+    ASSERT_EQ(0, ring_buffer_used(&ring));
+    for (size_t i = 0; i < 3; i++) {
+      ASSERT_EQ(i + 1, out[used + i].foo);
+      ASSERT_EQ(msgs[i].sub.sub_bar, out[used + i].sub.sub_bar);
+    }
+  }
+
+  // Incomplete message stays in ring
+  uint8_t tmp[protobufs_Test_size + 1];
+  pb_ostream_t ostream = pb_ostream_from_buffer(tmp, sizeof(tmp));
+  ASSERT_TRUE(pb_encode_delimited(&ostream, protobufs_Test_fields, &msgs[5]));
+  ASSERT_TRUE(ring_buffer_write(&ring, tmp, ostream.bytes_written - 1));
+  ASSERT_EQ(0, pb_decode_batch_from_ring_buffer(&ring, protobufs_Test_fields, out, sizeof(out[0]), 8));
+  ASSERT_EQ(msg_len, ring_buffer_used(&ring));
+}
+
+TEST(ring_buffer_nanopb, batch_malformed)
+{
+  uint8_t buf[100];
+  struct ring_buffer ring;
+  ring_buffer_init(&ring, buf, sizeof(buf));
+
+  protobufs_Test msgs[2];
+  fill_test_msg(&msgs[0]);
+  fill_test_msg(&msgs[1]);
+  msgs[1].foo = 2;
+  size_t msg_len;
+  ASSERT_TRUE(pb_get_encoded_size(&msg_len, protobufs_Test_fields, &msgs[0]));
+
+  // Complete record with malformed body (unterminated varint tag) between
+  // valid messages
+  ASSERT_EQ(1, pb_encode_batch_to_ring_buffer(&ring, protobufs_Test_fields, msgs, sizeof(msgs[0]), 1));
+  uint8_t junk[] = {0xff, 0xff, 0xff};
+  ASSERT_TRUE(ring_buffer_write_record(&ring, junk, sizeof(junk)));
+  ASSERT_EQ(1, pb_encode_batch_to_ring_buffer(&ring, protobufs_Test_fields, &msgs[1], sizeof(msgs[0]), 1));
+
+  // Malformed record is dropped, both valid messages are decoded
+  protobufs_Test out[4];
+  ASSERT_EQ(2, pb_decode_batch_from_ring_buffer(&ring, protobufs_Test_fields, out, sizeof(out[0]), 4));
+  ASSERT_EQ(1, out[0].foo);
+  ASSERT_EQ(2, out[1].foo);
+  ASSERT_EQ(0, ring_buffer_used(&ring));
+  ASSERT_EQ(1 + sizeof(junk), ring.dropped);
+
+  // Malformed record first: does not block the following ones
+  ASSERT_TRUE(ring_buffer_write_record(&ring, junk, sizeof(junk)));
+  ASSERT_EQ(1, pb_encode_batch_to_ring_buffer(&ring, protobufs_Test_fields, &msgs[1], sizeof(msgs[0]), 1));
+  ASSERT_EQ(1, pb_decode_batch_from_ring_buffer(&ring, protobufs_Test_fields, out, sizeof(out[0]), 4));
+  ASSERT_EQ(2, out[0].foo);
+  ASSERT_EQ(0, ring_buffer_used(&ring));
+  ASSERT_EQ(2 * (1 + sizeof(junk)), ring.dropped);
+}
+
+TEST(ring_buffer_nanopb, read_buffered)
+{
+  const size_t W = PB_RING_BUFFER_WINDOW_SIZE;
+  uint8_t buf[PB_RING_BUFFER_WINDOW_SIZE * 5];
+  for (size_t i = 0; i < sizeof(buf); i++) {
+    buf[i] = (uint8_t)i;
+  }
+  struct ring_buffer ring;
+  ring_buffer_init(&ring, buf, sizeof(buf));
+  // Message of 4 windows + 6 bytes rolled over buffer end, followed by 5 bytes
+  size_t msg_len = 4 * W + 6;
+  ring_buffer_advance_head(&ring, 30);
+  ring_buffer_read_consume(&ring, 30);
+  ring_buffer_advance_head(&ring, msg_len + 5);
+
+  struct pb_ring_buffer_istream state;
+  pb_istream_t stream = pb_istream_from_ring_buffer_buffered(&state, &ring, msg_len);
+  ASSERT_EQ(&state, stream.state);
+
+  // Chunks not smaller than window bypass it once it is drained:
+  // - W - 5 drains window exactly, then W + 1 is read directly from ring
+  // - 2 * W drains remaining W - 3 bytes of window, then W + 3 directly
+  // Others are served from window, refilled up to message end only.
+  struct {
+    size_t len;
+    bool   direct;
+  } chunks[] = {
+    {1, false}, {1, false}, {3, false}, {W - 5, false}, {W + 1, true},
+    {3, false}, {2 * W, true}, {2, false},
+  };
+  size_t pos = 30;
+  for (size_t c = 0; c < sizeof(chunks) / sizeof(chunks[0]); c++) {
+    uint8_t test[PB_RING_BUFFER_WINDOW_SIZE * 2];
+    ASSERT_TRUE(pb_read(&stream, test, chunks[c].len));
+    for (size_t i = 0; i < chunks[c].len; i++, pos++) {
+      ASSERT_EQ((uint8_t)(pos % sizeof(buf)), test[i]) << "chunk " << c << " index " << i;
+    }
+    // Direct read leaves window empty
+    ASSERT_EQ(chunks[c].direct, state.len == 0) << "chunk " << c;
+  }
+  // Bytes beyond the message are not prefetched
+  ASSERT_EQ(5, ring_buffer_used(&ring));
+  uint8_t test[1];
+  ASSERT_FALSE(pb_read(&stream, test, 1));
+}
+
+TEST(ring_buffer_nanopb, encode_decode_buffered)
+{
+  protobufs_Test msg;
+  fill_test_msg(&msg);
+  size_t msg_len;
+  ASSERT_TRUE(pb_get_encoded_size(&msg_len, protobufs_Test_fields, &msg));
+
+  // Buffer is 1 byte longer than message: almost every message wraps
+  uint8_t buf[protobufs_Test_size + 1];
+  struct ring_buffer ring;
+  ring_buffer_init(&ring, buf, msg_len + 1);
+
+  for (int32_t i = 0; i < 50; i++) {
+    msg.foo = i + 1;
+    struct pb_ring_buffer_ostream ostate;
+    pb_ostream_t ostream = pb_ostream_from_ring_buffer_buffered(&ostate, &ring);
+    ASSERT_TRUE(pb_encode(&ostream, protobufs_Test_fields, &msg));
+    // Nothing is visible until flushed
+    ASSERT_EQ(0, ring_buffer_used(&ring));
+    ASSERT_TRUE(pb_ring_buffer_ostream_flush(&ostate));
+    ASSERT_EQ(msg_len, ring_buffer_used(&ring));
+
+    protobufs_Test msg2 = protobufs_Test_init_default;
+    struct pb_ring_buffer_istream istate;
+    pb_istream_t istream = pb_istream_from_ring_buffer_buffered(&istate, &ring, msg_len);
+    ASSERT_TRUE(pb_decode(&istream, protobufs_Test_fields, &msg2));
+    ASSERT_EQ(0, ring_buffer_used(&ring));
+    ASSERT_EQ(msg.foo, msg2.foo);
+    ASSERT_EQ(msg.bar, msg2.bar);
+    ASSERT_EQ(msg.sub.sub_foo, msg2.sub.sub_foo);
+    ASSERT_EQ(msg.sub.sub_bar, msg2.sub.sub_bar);
+  }
+}
+
+TEST(ring_buffer_nanopb, cobs)
+{
+  uint8_t msg_buf[40], tx_buf[50], rx_buf[40];
+  struct ring_buffer msg_ring, tx, rx;
+  ring_buffer_init(&msg_ring, msg_buf, sizeof(msg_buf));
+  ring_buffer_init(&tx, tx_buf, sizeof(tx_buf));
+  ring_buffer_init(&rx, rx_buf, sizeof(rx_buf));
+  struct ring_buffer_cobs_decoder dec;
+  ring_buffer_cobs_decoder_init(&dec, &rx);
+
+  protobufs_Test msg;
+  fill_test_msg(&msg);
+
+  for (int32_t i = 0; i < 20; i++) {
+    msg.foo = i;
+    // Sender: message -> COBS frame
+    size_t msg_len = ring_buffer_used(&msg_ring);
+    ASSERT_TRUE(pb_encode_to_ring_buffer(&msg_ring, protobufs_Test_fields, &msg));
+    msg_len = ring_buffer_used(&msg_ring) - msg_len;
+    ASSERT_TRUE(ring_buffer_cobs_encode_ring(&tx, &msg_ring, msg_len));
+
+    // Receiver: COBS frame -> message
+    uint32_t frame_len;
+    ASSERT_TRUE(ring_buffer_cobs_decode(&dec, &tx, &frame_len));
+    ASSERT_EQ(msg_len, frame_len);
+    protobufs_Test msg2 = protobufs_Test_init_default;
+    ASSERT_TRUE(pb_decode_from_ring_buffer(&rx, frame_len, protobufs_Test_fields, &msg2));
+    ASSERT_EQ(i, msg2.foo);
+    ASSERT_EQ(msg.sub.sub_bar, msg2.sub.sub_bar);
+    ASSERT_EQ(0, ring_buffer_used(&rx));
+  }
+}
@@ -0,0 +1,179 @@
+// Copyright (c) Konstantin Belyalov. All rights reserved.
+// Licensed under the MIT license.
+
+#include <gtest/gtest.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "ring_buffer_spsc.h"
+
+using namespace std;
+
+// Total amount of data pushed through ring in stress test
+#define STRESS_TOTAL_BYTES    (256ULL * 1024 * 1024)
+#define STRESS_MAX_CHUNK      1024
+
+
+TEST(ring_buffer_spsc, init)
+{
+  struct ring_buffer_spsc ring;
+  uint8_t ringbuf[16];
+
+  // Only power of two sizes allowed
+  ASSERT_FALSE(ring_buffer_spsc_init(&ring, ringbuf, 0));
+  ASSERT_FALSE(ring_buffer_spsc_init(&ring, ringbuf, 10));
+  ASSERT_TRUE(ring_buffer_spsc_init(&ring, ringbuf, 16));
+  ASSERT_EQ(0, ring_buffer_spsc_used(&ring));
+  ASSERT_EQ(16, ring_buffer_spsc_free(&ring));
+}
+
+TEST(ring_buffer_spsc, read_write)
+{
+  struct ring_buffer_spsc ring;
+  uint8_t ringbuf[8] = {};
+  ASSERT_TRUE(ring_buffer_spsc_init(&ring, ringbuf, sizeof(ringbuf)));
+
+  // Read from empty buffer
+  uint8_t rd[8] = {};
+  ASSERT_FALSE(ring_buffer_spsc_read(&ring, rd, 1));
+
+  // Write too big chunk
+  uint8_t wr[16] = {1, 2, 3, 4, 5, 6, 7, 8, 9};
+  ASSERT_FALSE(ring_buffer_spsc_write(&ring, wr, 9));
+
+  // Fill buffer completely: full buffer is distinguishable from empty
+  ASSERT_TRUE(ring_buffer_spsc_write(&ring, wr, 8));
+  ASSERT_EQ(8, ring_buffer_spsc_used(&ring));
+  ASSERT_EQ(0, ring_buffer_spsc_free(&ring));
+  ASSERT_FALSE(ring_buffer_spsc_write(&ring, wr, 1));
+  ASSERT_TRUE(ring_buffer_spsc_read(&ring, rd, 5));
+  for (size_t i = 0; i < 5; i++) {
+    ASSERT_EQ(wr[i], rd[i]) << "index " << i;
+  }
+
+  // Rollover: 3 bytes left + 5 more written
+  ASSERT_TRUE(ring_buffer_spsc_write(&ring, wr, 5));
+  ASSERT_EQ(8, ring_buffer_spsc_used(&ring));
+  ASSERT_TRUE(ring_buffer_spsc_read(&ring, rd, 8));
+  uint8_t expected[8] = {6, 7, 8, 1, 2, 3, 4, 5};
+  for (size_t i = 0; i < 8; i++) {
+    ASSERT_EQ(expected[i], rd[i]) << "index " << i;
+  }
+  ASSERT_EQ(0, ring_buffer_spsc_used(&ring));
+}
+
+TEST(ring_buffer_spsc, index_overflow)
+{
+  struct ring_buffer_spsc ring;
+  uint8_t ringbuf[8] = {};
+  ASSERT_TRUE(ring_buffer_spsc_init(&ring, ringbuf, sizeof(ringbuf)));
+
+  // Emulate free running indexes close to uint32_t overflow
+  ring.head = 0xfffffffe;
+  ring.tail = 0xfffffffe;
+
+  uint8_t wr[6] = {1, 2, 3, 4, 5, 6};
+  uint8_t rd[6] = {};
+  ASSERT_TRUE(ring_buffer_spsc_write(&ring, wr, sizeof(wr)));
+  ASSERT_EQ(6, ring_buffer_spsc_used(&ring));
+  ASSERT_EQ(2, ring_buffer_spsc_free(&ring));
+  ASSERT_TRUE(ring_buffer_spsc_read(&ring, rd, sizeof(rd)));
+  for (size_t i = 0; i < sizeof(wr); i++) {
+    ASSERT_EQ(wr[i], rd[i]) << "index " << i;
+  }
+  ASSERT_EQ(0, ring_buffer_spsc_used(&ring));
+}
+
+// Stress test: producer and consumer threads are working concurrently,
+// using random chunk sizes. Every byte in stream is derived from its position,
+// so any loss / duplication / corruption will be detected by consumer.
+static inline uint8_t stream_byte(uint64_t pos)
+{
+  return (uint8_t)(pos ^ (pos >> 8) ^ (pos >> 16));
+}
+
+static inline uint32_t xorshift32(uint32_t* state)
+{
+  uint32_t x = *state;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  *state = x;
+  return x;
+}
+
+static void* stress_producer(void* arg)
+{
+  struct ring_buffer_spsc* ring = (struct ring_buffer_spsc*)arg;
+  uint8_t chunk[STRESS_MAX_CHUNK];
+  uint32_t rnd = 0x12345678;
+  uint64_t pos = 0;
+
+  while (pos < STRESS_TOTAL_BYTES) {
+    uint32_t len = xorshift32(&rnd) % STRESS_MAX_CHUNK + 1;
+    if (len > STRESS_TOTAL_BYTES - pos) {
+      len = STRESS_TOTAL_BYTES - pos;
+    }
+    for (uint32_t i = 0; i < len; i++) {
+      chunk[i] = stream_byte(pos + i);
+    }
+    while (!ring_buffer_spsc_write(ring, chunk, len)) {
+      sched_yield();
+    }
+    pos += len;
+  }
+
+  return NULL;
+}
+
+static void* stress_consumer(void* arg)
+{
+  struct ring_buffer_spsc* ring = (struct ring_buffer_spsc*)arg;
+  uint8_t chunk[STRESS_MAX_CHUNK];
+  uint32_t rnd = 0x87654321;
+  uint64_t pos = 0;
+  uint64_t errors = 0;
+
+  while (pos < STRESS_TOTAL_BYTES) {
+    uint32_t len = xorshift32(&rnd) % STRESS_MAX_CHUNK + 1;
+    uint32_t used = ring_buffer_spsc_used(ring);
+    if (used == 0) {
+      sched_yield();
+      continue;
+    }
+    if (len > used) {
+      len = used;
+    }
+    if (!ring_buffer_spsc_read(ring, chunk, len)) {
+      // Consumer is the only one who decreases amount of data, so it must never fail
+      errors++;
+      break;
+    }
+    for (uint32_t i = 0; i < len; i++) {
+      if (chunk[i] != stream_byte(pos + i)) {
+        errors++;
+      }
+    }
+    pos += len;
+  }
+
+  return (void*)(uintptr_t)errors;
+}
+
+TEST(ring_buffer_spsc, stress_threads)
+{
+  struct ring_buffer_spsc ring;
+  static uint8_t ringbuf[4096];
+  ASSERT_TRUE(ring_buffer_spsc_init(&ring, ringbuf, sizeof(ringbuf)));
+
+  pthread_t producer, consumer;
+  ASSERT_EQ(0, pthread_create(&consumer, NULL, stress_consumer, &ring));
+  ASSERT_EQ(0, pthread_create(&producer, NULL, stress_producer, &ring));
+
+  void* errors;
+  ASSERT_EQ(0, pthread_join(producer, NULL));
+  ASSERT_EQ(0, pthread_join(consumer, &errors));
+
+  ASSERT_EQ(0, (uintptr_t)errors);
+  ASSERT_EQ(0, ring_buffer_spsc_used(&ring));
+}
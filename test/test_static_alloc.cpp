@@ -2,6 +2,7 @@
 // Licensed under the MIT license.
 
 #include <gtest/gtest.h>
+#include <pthread.h>
 #include "static_alloc.h"
 
 using namespace std;
@@ -142,3 +143,702 @@ TEST(static_alloc, many_blocks) {
   static_alloc_free(p1);
   ASSERT_EQ(4032, static_alloc_info_mem_free());
 }
+
+// Reference (bit by bit) first fit search
+static int32_t first_fit(uint32_t blocks)
+{
+  uint32_t found = 0;
+
+  for (uint32_t i = 0; i < unittest_blocks_count(); i++) {
+    found = unittest_is_block_free(i) ? found + 1 : 0;
+    if (found == blocks) {
+      return i - blocks + 1;
+    }
+  }
+  return -1;
+}
+
+TEST(static_alloc, first_fit_random) {
+  static uint8_t buf[16384];  // 255 blocks, 8 status words
+  static_alloc_init(buf, sizeof(buf));
+  ASSERT_EQ(255, unittest_blocks_count());
+
+  vector<void*> items;
+  srand(1);
+  for (int i = 0; i < 20000; i++) {
+    if (items.empty() || rand() % 2) {
+      // Mostly small items, sometimes several words long
+      uint32_t size = rand() % 8 ? rand() % 200 : rand() % 5000;
+      uint32_t blocks = (size + 4 + STATIC_ALLOC_BLOCK_SIZE - 1) / STATIC_ALLOC_BLOCK_SIZE;
+      int32_t expected = first_fit(blocks);
+      void* p = static_alloc_alloc(size);
+      if (expected < 0) {
+        ASSERT_FALSE(p);
+        continue;
+      }
+      ASSERT_TRUE(p);
+      ASSERT_EQ(expected, ((uint8_t*)p - unittest_user_data_starts_at()) / STATIC_ALLOC_BLOCK_SIZE);
+      items.push_back(p);
+    } else {
+      size_t idx = rand() % items.size();
+      static_alloc_free(items[idx]);
+      items.erase(items.begin() + idx);
+    }
+    // Free memory is counted correctly
+    uint32_t free = 0;
+    for (uint32_t b = 0; b < unittest_blocks_count(); b++) {
+      free += unittest_is_block_free(b) ? STATIC_ALLOC_BLOCK_SIZE : 0;
+    }
+    ASSERT_EQ(free, static_alloc_info_mem_free());
+  }
+}
+
+TEST(static_alloc, arenas) {
+  uint8_t buf1[256];
+  uint8_t buf2[128];
+  struct static_alloc_arena a1, a2;
+  static_alloc_arena_init(&a1, buf1, sizeof(buf1));
+  static_alloc_arena_init(&a2, buf2, sizeof(buf2));
+  ASSERT_EQ(192, static_alloc_arena_info_mem_free(&a1));
+  ASSERT_EQ(64, static_alloc_arena_info_mem_free(&a2));
+
+  // Arenas are independent
+  void* p1 = static_alloc_arena_alloc(&a2, 1);
+  ASSERT_TRUE(p1);
+  ASSERT_TRUE(p1 > buf2 && p1 < buf2 + sizeof(buf2));
+  ASSERT_FALSE(static_alloc_arena_alloc(&a2, 1));
+  ASSERT_EQ(192, static_alloc_arena_info_mem_free(&a1));
+
+  void* p2 = static_alloc_arena_alloc(&a1, 100);
+  ASSERT_TRUE(p2);
+  ASSERT_TRUE(p2 > buf1 && p2 < buf1 + sizeof(buf1));
+  ASSERT_EQ(64, static_alloc_arena_info_mem_free(&a1));
+
+  // Ref counting works the same way
+  ASSERT_EQ(p1, static_alloc_copy(p1));
+  static_alloc_arena_free(&a2, p1);
+  ASSERT_EQ(0, static_alloc_arena_info_mem_free(&a2));
+  static_alloc_arena_free(&a2, p1);
+  ASSERT_EQ(64, static_alloc_arena_info_mem_free(&a2));
+
+  static_alloc_arena_free(&a1, p2);
+  ASSERT_EQ(192, static_alloc_arena_info_mem_free(&a1));
+}
+
+TEST(static_alloc, size_classes) {
+  uint8_t buf[4096];  // 63 blocks
+  static_alloc_init(buf, sizeof(buf));
+
+  struct static_alloc_class classes[] = {
+    {32, 4},    // 1 block each
+    {128, 2},   // 3 blocks each
+  };
+  ASSERT_TRUE(static_alloc_init_classes(classes, 2));
+  // Class items are reserved upfront
+  ASSERT_EQ((63 - 4 - 6) * 64, static_alloc_info_mem_free());
+  uint32_t mem_free = static_alloc_info_mem_free();
+
+  // Served from classes: regular blocks are not touched
+  void* small[5];
+  for (int i = 0; i < 4; i++) {
+    small[i] = static_alloc_alloc(20);
+    ASSERT_TRUE(small[i]);
+  }
+  void* medium = static_alloc_alloc(100);
+  ASSERT_TRUE(medium);
+  ASSERT_EQ(mem_free, static_alloc_info_mem_free());
+  ASSERT_EQ(4, classes[0].hits);
+  ASSERT_EQ(1, classes[1].hits);
+  ASSERT_EQ(0, classes[0].misses);
+
+  // Class is exhausted: fallback to regular allocation
+  small[4] = static_alloc_alloc(20);
+  ASSERT_TRUE(small[4]);
+  ASSERT_EQ(1, classes[0].misses);
+  ASSERT_EQ(mem_free - 64, static_alloc_info_mem_free());
+
+  // Sizes above the largest class are not counted
+  void* big = static_alloc_alloc(500);
+  ASSERT_TRUE(big);
+  ASSERT_EQ(1, classes[1].hits);
+  ASSERT_EQ(0, classes[1].misses);
+
+  // Ref counting: item goes back to class only when released by all owners
+  static_alloc_copy(small[0]);
+  static_alloc_free(small[0]);
+  static_alloc_free(small[1]);
+  ASSERT_EQ(small[1], static_alloc_alloc(1));
+  ASSERT_EQ(5, classes[0].hits);
+  static_alloc_free(small[0]);
+  ASSERT_EQ(small[0], static_alloc_alloc(1));
+
+  // Release all
+  for (int i = 0; i < 5; i++) {
+    static_alloc_free(small[i]);
+  }
+  static_alloc_free(medium);
+  static_alloc_free(big);
+  ASSERT_EQ(mem_free, static_alloc_info_mem_free());
+}
+
+TEST(static_alloc, size_classes_no_memory) {
+  uint8_t buf[256];  // 3 blocks
+  static_alloc_init(buf, sizeof(buf));
+
+  struct static_alloc_class classes[] = {
+    {32, 4},
+  };
+  ASSERT_FALSE(static_alloc_init_classes(classes, 1));
+  ASSERT_EQ(0, static_alloc_info_mem_free());
+  // Items which were reserved are still usable
+  ASSERT_TRUE(static_alloc_alloc(1));
+  ASSERT_EQ(1, classes[0].hits);
+}
+
+TEST(static_alloc, realloc) {
+  uint8_t buf[64 * 9];
+  static_alloc_init(buf, sizeof(buf));
+  ASSERT_EQ(8 * 64, static_alloc_info_mem_free());
+
+  // NULL: regular allocation
+  uint8_t* p1 = (uint8_t*)static_alloc_realloc(NULL, 10);
+  ASSERT_TRUE(p1);
+  memset(p1, 0x11, 10);
+  // Grow in place: adjacent blocks are free
+  ASSERT_EQ(p1, static_alloc_realloc(p1, 200));
+  ASSERT_EQ(4 * 64, static_alloc_info_mem_free());
+  for (int i = 0; i < 10; i++) {
+    ASSERT_EQ(0x11, p1[i]);
+  }
+  // Shrink: trailing blocks are released
+  ASSERT_EQ(p1, static_alloc_realloc(p1, 60));
+  ASSERT_EQ(7 * 64, static_alloc_info_mem_free());
+  ASSERT_TRUE(unittest_is_block_used(0));
+  ASSERT_TRUE(unittest_is_block_free(1));
+
+  // Next item right after p1: no room to grow in place, data moved
+  void* p2 = static_alloc_alloc(1);
+  ASSERT_TRUE(unittest_is_block_used(1));
+  memset(p1, 0x22, 60);
+  uint8_t* p3 = (uint8_t*)static_alloc_realloc(p1, 100);
+  ASSERT_TRUE(p3);
+  ASSERT_NE(p1, p3);
+  ASSERT_TRUE(unittest_is_block_free(0));
+  for (int i = 0; i < 60; i++) {
+    ASSERT_EQ(0x22, p3[i]);
+  }
+  ASSERT_EQ(5 * 64, static_alloc_info_mem_free());
+
+  // Out of memory: original item untouched
+  ASSERT_FALSE(static_alloc_realloc(p3, 8 * 64));
+  ASSERT_EQ(5 * 64, static_alloc_info_mem_free());
+
+  // Shared item is never moved
+  static_alloc_copy(p2);
+  ASSERT_FALSE(static_alloc_realloc(p2, 100));
+  static_alloc_free(p2);
+  // ... nor shrunk: its trailing blocks are still in use by other owners
+  ASSERT_EQ(p3, static_alloc_copy(p3));
+  ASSERT_EQ(p3, static_alloc_realloc(p3, 10));
+  ASSERT_EQ(5 * 64, static_alloc_info_mem_free());
+  ASSERT_TRUE(unittest_is_block_used(3));
+  static_alloc_free(p3);
+  // Not shared anymore: shrinks
+  ASSERT_EQ(p3, static_alloc_realloc(p3, 10));
+  ASSERT_EQ(6 * 64, static_alloc_info_mem_free());
+  ASSERT_TRUE(unittest_is_block_free(3));
+  // ... but may be resized in place
+  static_alloc_free(p3);
+  ASSERT_EQ(p2, static_alloc_realloc(p2, 100));
+  static_alloc_free(p2);
+  ASSERT_EQ(8 * 64, static_alloc_info_mem_free());
+}
+
+TEST(static_alloc, realloc_classes) {
+  uint8_t buf[1024];
+  static_alloc_init(buf, sizeof(buf));
+  struct static_alloc_class classes[] = {
+    {32, 1},
+  };
+  ASSERT_TRUE(static_alloc_init_classes(classes, 1));
+  uint32_t mem_free = static_alloc_info_mem_free();
+
+  uint8_t* p1 = (uint8_t*)static_alloc_alloc(10);
+  ASSERT_EQ(1U, classes[0].hits);
+  // Fits into class item
+  ASSERT_EQ(p1, static_alloc_realloc(p1, 32));
+  memset(p1, 0x33, 32);
+  // Class item can not grow: moved into regular item
+  uint8_t* p2 = (uint8_t*)static_alloc_realloc(p1, 100);
+  ASSERT_TRUE(p2);
+  ASSERT_NE(p1, p2);
+  for (int i = 0; i < 32; i++) {
+    ASSERT_EQ(0x33, p2[i]);
+  }
+  ASSERT_EQ(mem_free - 2 * 64, static_alloc_info_mem_free());
+  // Class item is back in free list
+  ASSERT_EQ(p1, static_alloc_alloc(1));
+  static_alloc_free(p1);
+  static_alloc_free(p2);
+  ASSERT_EQ(mem_free, static_alloc_info_mem_free());
+}
+
+TEST(static_alloc, stats) {
+  uint8_t buf[64 * 9];
+  struct static_alloc_stats stats;
+  static_alloc_init(buf, sizeof(buf));
+
+  static_alloc_stats(&stats);
+  ASSERT_EQ(0U, stats.allocs);
+  ASSERT_EQ(0U, stats.bytes_used);
+  ASSERT_EQ(0U, stats.high_water);
+  ASSERT_EQ(8U * 64, stats.bytes_free);
+  ASSERT_EQ(8U * 64, stats.largest_free);
+
+  // 8 single block items, then every other released:
+  // half of pool is free, but no 2 blocks run
+  void* items[8];
+  for (int i = 0; i < 8; i++) {
+    items[i] = static_alloc_alloc(10);
+  }
+  for (int i = 0; i < 8; i += 2) {
+    static_alloc_free(items[i]);
+  }
+  ASSERT_FALSE(static_alloc_alloc(100));
+  ASSERT_FALSE(static_alloc_alloc(5000));
+  static_alloc_stats(&stats);
+  ASSERT_EQ(8U, stats.allocs);
+  ASSERT_EQ(2U, stats.failures);
+  ASSERT_EQ(4U * 64, stats.bytes_used);
+  ASSERT_EQ(8U * 64, stats.bytes_peak);
+  ASSERT_EQ(8U * 64, stats.high_water);
+  ASSERT_EQ(4U * 64, stats.bytes_free);
+  ASSERT_EQ(64U, stats.largest_free);
+  ASSERT_EQ(8U, stats.sizes[0]);
+  ASSERT_EQ(1U, stats.failed_sizes[3]);
+  ASSERT_EQ(1U, stats.failed_sizes[STATIC_ALLOC_STATS_BUCKETS - 1]);
+
+  // Realloc in place
+  ASSERT_EQ(items[7], static_alloc_realloc(items[7], 1));
+  ASSERT_EQ(items[1], static_alloc_realloc(items[1], 100));
+  static_alloc_stats(&stats);
+  ASSERT_EQ(5U * 64, stats.bytes_used);
+  ASSERT_EQ(3U * 64, stats.bytes_free);
+
+  static_alloc_free(items[1]);
+  static_alloc_free(items[3]);
+  static_alloc_free(items[5]);
+  static_alloc_free(items[7]);
+  static_alloc_stats(&stats);
+  ASSERT_EQ(0U, stats.bytes_used);
+  ASSERT_EQ(8U * 64, stats.bytes_peak);
+  ASSERT_EQ(8U * 64, stats.largest_free);
+}
+
+TEST(static_alloc, stats_classes) {
+  uint8_t buf[64 * 100];
+  struct static_alloc_stats stats;
+  static_alloc_init(buf, sizeof(buf));
+  struct static_alloc_class classes[] = {
+    {32, 2},
+  };
+  ASSERT_TRUE(static_alloc_init_classes(classes, 1));
+
+  // Class items are taken from pool, but not in use yet
+  static_alloc_stats(&stats);
+  ASSERT_EQ(0U, stats.allocs);
+  ASSERT_EQ(0U, stats.bytes_used);
+  ASSERT_EQ(2U * 64, stats.high_water);
+
+  void* p1 = static_alloc_alloc_isr(20);
+  void* p2 = static_alloc_alloc(30);
+  ASSERT_FALSE(static_alloc_alloc_isr(30));
+  void* p3 = static_alloc_alloc(1000);
+  static_alloc_stats(&stats);
+  ASSERT_EQ(3U, stats.allocs);
+  ASSERT_EQ(1U, stats.failures);
+  ASSERT_EQ(2U, stats.sizes[1]);
+  ASSERT_EQ(1U, stats.sizes[6]);
+  ASSERT_EQ(1U, stats.failed_sizes[1]);
+  ASSERT_EQ((2U + 16) * 64, stats.bytes_used);
+  ASSERT_EQ((2U + 16) * 64, stats.high_water);
+
+  static_alloc_free(p1);
+  static_alloc_free(p2);
+  static_alloc_free(p3);
+  static_alloc_stats(&stats);
+  ASSERT_EQ(0U, stats.bytes_used);
+  ASSERT_EQ((2U + 16) * 64, stats.bytes_peak);
+}
+
+TEST(static_alloc, policies) {
+  uint8_t buf[64 * 11];
+  static_alloc_init(buf, sizeof(buf));
+  ASSERT_EQ(10U, unittest_blocks_count());
+  uint8_t* start = unittest_user_data_starts_at();
+#define BLOCK(p) (((uint8_t*)(p) - start) / 64)
+
+  // Free runs: 1 block at 1, 3 blocks at 3, 2 blocks at 7
+  // [U F U F F F U F F U]
+  void* items[10];
+  for (int i = 0; i < 10; i++) {
+    items[i] = static_alloc_alloc(1);
+  }
+  static_alloc_free(items[1]);
+  for (int i = 3; i < 6; i++) {
+    static_alloc_free(items[i]);
+  }
+  static_alloc_free(items[7]);
+  static_alloc_free(items[8]);
+
+  // First fit: the lowest run
+  void* p = static_alloc_alloc(100);
+  ASSERT_EQ(3, BLOCK(p));
+  static_alloc_free(p);
+
+  // Best fit: the smallest run
+  static_alloc_set_policy(STATIC_ALLOC_BEST_FIT);
+  p = static_alloc_alloc(100);
+  ASSERT_EQ(7, BLOCK(p));
+  static_alloc_free(p);
+  p = static_alloc_alloc(1);
+  ASSERT_EQ(1, BLOCK(p));
+  static_alloc_free(p);
+  p = static_alloc_alloc(150);
+  ASSERT_EQ(3, BLOCK(p));
+  static_alloc_free(p);
+  ASSERT_FALSE(static_alloc_alloc(200));
+
+  // Long lived: the end of the last run which fits
+  p = static_alloc_alloc_ex(1, STATIC_ALLOC_LONG_LIVED);
+  ASSERT_EQ(8, BLOCK(p));
+  static_alloc_free(p);
+  p = static_alloc_alloc_ex(150, STATIC_ALLOC_LONG_LIVED);
+  ASSERT_EQ(3, BLOCK(p));
+  static_alloc_free(p);
+
+  // Next fit: continues after previous allocation, wraps around
+  static_alloc_set_policy(STATIC_ALLOC_NEXT_FIT);
+  void* n1 = static_alloc_alloc(1);
+  void* n2 = static_alloc_alloc(1);
+  ASSERT_EQ(1, BLOCK(n1));
+  ASSERT_EQ(3, BLOCK(n2));
+  static_alloc_free(n1);
+  static_alloc_free(n2);
+  static_alloc_set_policy(STATIC_ALLOC_FIRST_FIT);
+
+  static_alloc_free(items[0]);
+  static_alloc_free(items[2]);
+  static_alloc_free(items[6]);
+  static_alloc_free(items[9]);
+  ASSERT_EQ(10U * 64, static_alloc_info_mem_free());
+#undef BLOCK
+}
+
+TEST(static_alloc, next_fit) {
+  // Several status words
+  uint8_t buf[64 * 101];
+  static_alloc_init(buf, sizeof(buf));
+  ASSERT_EQ(100U, unittest_blocks_count());
+  uint8_t* start = unittest_user_data_starts_at();
+  static_alloc_set_policy(STATIC_ALLOC_NEXT_FIT);
+
+  // Allocated one after another, released item is not reused right away
+  void* items[100];
+  for (int i = 0; i < 50; i++) {
+    items[i] = static_alloc_alloc(1);
+    ASSERT_EQ(start + i * 64 + 4, items[i]);
+  }
+  static_alloc_free(items[0]);
+  void* p = static_alloc_alloc(1);
+  ASSERT_EQ(start + 50 * 64 + 4, p);
+  static_alloc_free(p);
+  // Pool end reached: wraps around
+  p = static_alloc_alloc(50 * 64 - 4);
+  ASSERT_EQ(start + 50 * 64 + 4, p);
+  void* p2 = static_alloc_alloc(1);
+  ASSERT_EQ(start + 4, p2);
+  ASSERT_FALSE(static_alloc_alloc(1));
+
+  static_alloc_free(p);
+  static_alloc_free(p2);
+  for (int i = 1; i < 50; i++) {
+    static_alloc_free(items[i]);
+  }
+  ASSERT_EQ(100U * 64, static_alloc_info_mem_free());
+  static_alloc_set_policy(STATIC_ALLOC_FIRST_FIT);
+}
+
+#ifdef STATIC_ALLOC_TRACE
+TEST(static_alloc, trace) {
+  uint8_t buf[64 * 11];
+  uint8_t trace_buf[sizeof(struct static_alloc_trace_event) * 7];
+  struct ring_buffer trace;
+  struct static_alloc_trace_event events[7];
+
+  static_alloc_init(buf, sizeof(buf));
+  ring_buffer_init(&trace, trace_buf, sizeof(trace_buf));
+  static_alloc_trace_start(&trace);
+
+  void* p1 = static_alloc_alloc(10);
+  void* p2 = static_alloc_alloc_ex(100, STATIC_ALLOC_LONG_LIVED);
+  static_alloc_copy(p1);
+  ASSERT_EQ(p1, static_alloc_realloc(p1, 20));
+  ASSERT_FALSE(static_alloc_alloc(1000));
+  static_alloc_free(p1);
+  static_alloc_free(p1);
+  // Ring is full: dropped
+  static_alloc_free(p2);
+  static_alloc_trace_start(NULL);
+  // Not recorded
+  static_alloc_free(static_alloc_alloc(1));
+
+  ASSERT_EQ(sizeof(struct static_alloc_trace_event), trace.dropped);
+  ASSERT_TRUE(ring_buffer_read(&trace, (uint8_t*)events, sizeof(events)));
+  ASSERT_EQ(0U, ring_buffer_used(&trace));
+
+  ASSERT_EQ(STATIC_ALLOC_TRACE_ALLOC, events[0].op);
+  ASSERT_EQ(0, events[0].block);
+  ASSERT_EQ(10U, events[0].size);
+  ASSERT_EQ(STATIC_ALLOC_TRACE_ALLOC, events[1].op);
+  ASSERT_EQ(8, events[1].block);
+  ASSERT_EQ(STATIC_ALLOC_LONG_LIVED, events[1].flags);
+  ASSERT_EQ(STATIC_ALLOC_TRACE_COPY, events[2].op);
+  ASSERT_EQ(0, events[2].block);
+  ASSERT_EQ(STATIC_ALLOC_TRACE_REALLOC, events[3].op);
+  ASSERT_EQ(20U, events[3].size);
+  ASSERT_EQ(STATIC_ALLOC_TRACE_ALLOC, events[4].op);
+  ASSERT_EQ(STATIC_ALLOC_TRACE_NO_BLOCK, events[4].block);
+  ASSERT_EQ(1000U, events[4].size);
+  ASSERT_EQ(STATIC_ALLOC_TRACE_FREE, events[5].op);
+  ASSERT_EQ(STATIC_ALLOC_TRACE_FREE, events[6].op);
+  ASSERT_EQ(0, events[6].block);
+}
+#endif
+
+TEST(static_alloc, large_pool) {
+  // 4096 blocks: bitmap takes 512 bytes, i.e. 8 metadata blocks
+  static uint8_t buf[256 * 1024];
+  static_alloc_init(buf, sizeof(buf));
+  ASSERT_EQ(4088, unittest_blocks_count());
+  ASSERT_EQ(buf + 8 * STATIC_ALLOC_BLOCK_SIZE, unittest_user_data_starts_at());
+  ASSERT_EQ(4088 * 64, static_alloc_info_mem_free());
+
+  // Items larger than the old 31744 bytes pool limit
+  void* p1 = static_alloc_alloc(100000);
+  ASSERT_TRUE(p1);
+  // Rest of pool: 4088 - 1563 blocks
+  void* p2 = static_alloc_alloc((4088 - 1563) * 64 - 4);
+  ASSERT_TRUE(p2);
+  // Last block
+  ASSERT_TRUE(unittest_is_block_used(4087));
+  ASSERT_FALSE(static_alloc_alloc(10000));
+
+  static_alloc_free(p1);
+  static_alloc_free(p2);
+  ASSERT_EQ(4088 * 64, static_alloc_info_mem_free());
+
+  // Fill whole pool with single block items
+  vector<void*> items;
+  for (void* p = static_alloc_alloc(1); p; p = static_alloc_alloc(1)) {
+    items.push_back(p);
+  }
+  ASSERT_EQ(4088, items.size());
+  ASSERT_EQ(0, static_alloc_info_mem_free());
+}
+
+TEST(static_alloc, huge_size) {
+  uint8_t buf[64 * 5];
+  static_alloc_init(buf, sizeof(buf));
+  uint8_t* p1 = (uint8_t*)static_alloc_alloc(10);
+  ASSERT_TRUE(p1);
+  memset(p1, 0x33, 10);
+
+  // Sizes above item limit (0x7FFF blocks), including ones which would wrap
+  // around in blocks calculation on 32 bit targets
+  uint32_t sizes[] = {0x7FFF * 64 - 3, 0xFFFFFFBD, UINT32_MAX - 63, UINT32_MAX};
+  for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+    ASSERT_FALSE(static_alloc_alloc(sizes[i])) << "size " << sizes[i];
+    ASSERT_FALSE(static_alloc_alloc_ex(sizes[i], STATIC_ALLOC_LONG_LIVED));
+    // Original item untouched, shared or not
+    ASSERT_FALSE(static_alloc_realloc(p1, sizes[i]));
+    static_alloc_copy(p1);
+    ASSERT_FALSE(static_alloc_realloc(p1, sizes[i]));
+    static_alloc_free(p1);
+    ASSERT_EQ(3 * 64, static_alloc_info_mem_free());
+    for (int j = 0; j < 10; j++) {
+      ASSERT_EQ(0x33, p1[j]);
+    }
+  }
+  static_alloc_free(p1);
+  ASSERT_EQ(4 * 64, static_alloc_info_mem_free());
+}
+
+TEST(static_alloc, tiny_pool) {
+  // Not enough memory even for metadata block plus one user block
+  uint8_t buf[STATIC_ALLOC_BLOCK_SIZE * 2 - 1];
+  uint32_t sizes[] = {0, 1, STATIC_ALLOC_BLOCK_SIZE, sizeof(buf)};
+  for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+    static_alloc_init(buf, sizes[i]);
+    ASSERT_EQ(0, unittest_blocks_count()) << "size " << sizes[i];
+    ASSERT_EQ(0, static_alloc_info_mem_free());
+    ASSERT_FALSE(static_alloc_alloc(1));
+    struct static_alloc_stats stats;
+    static_alloc_stats(&stats);
+    ASSERT_EQ(0, stats.largest_free);
+  }
+
+  // The smallest usable pool
+  uint8_t buf2[STATIC_ALLOC_BLOCK_SIZE * 2];
+  static_alloc_init(buf2, sizeof(buf2));
+  ASSERT_EQ(1, unittest_blocks_count());
+  void* p1 = static_alloc_alloc(1);
+  ASSERT_TRUE(p1);
+  ASSERT_FALSE(static_alloc_alloc(1));
+  static_alloc_free(p1);
+  ASSERT_EQ(STATIC_ALLOC_BLOCK_SIZE, static_alloc_info_mem_free());
+}
+
+#define REFCOUNT_THREADS      4
+#define REFCOUNT_ITERATIONS   200000
+
+static void* refcount_hammer(void* arg)
+{
+  void* ptr = arg;
+
+  for (int i = 0; i < REFCOUNT_ITERATIONS; i++) {
+    static_alloc_copy(ptr);
+    static_alloc_copy(ptr);
+    static_alloc_free(ptr);
+    static_alloc_free(ptr);
+  }
+  return NULL;
+}
+
+struct refcount_release_args {
+  void* ptr;
+  pthread_barrier_t* barrier;
+};
+
+static void* refcount_release(void* arg)
+{
+  struct refcount_release_args* args = (struct refcount_release_args*)arg;
+
+  pthread_barrier_wait(args->barrier);
+  static_alloc_free(args->ptr);
+  return NULL;
+}
+
+TEST(static_alloc, refcount_threads) {
+  uint8_t buf[512];
+  static_alloc_init(buf, sizeof(buf));
+  struct static_alloc_class classes[] = {
+    {32, 1},
+  };
+  ASSERT_TRUE(static_alloc_init_classes(classes, 1));
+  uint32_t mem_free = static_alloc_info_mem_free();
+
+  // Concurrent copy / free of shared item: no lost updates
+  void* p1 = static_alloc_alloc(100);
+  ASSERT_TRUE(p1);
+  pthread_t threads[REFCOUNT_THREADS];
+  for (int i = 0; i < REFCOUNT_THREADS; i++) {
+    ASSERT_EQ(0, pthread_create(&threads[i], NULL, refcount_hammer, p1));
+  }
+  for (int i = 0; i < REFCOUNT_THREADS; i++) {
+    ASSERT_EQ(0, pthread_join(threads[i], NULL));
+  }
+  // Only initial reference left
+  ASSERT_EQ(mem_free - 2 * 64, static_alloc_info_mem_free());
+  static_alloc_free(p1);
+  ASSERT_EQ(mem_free, static_alloc_info_mem_free());
+
+  // Last references released concurrently: item is released exactly once
+  // (double release would put it into class free list twice)
+  for (int round = 0; round < 2000; round++) {
+    void* p2 = static_alloc_alloc(10);
+    ASSERT_TRUE(p2);
+    for (int i = 1; i < REFCOUNT_THREADS; i++) {
+      static_alloc_copy(p2);
+    }
+    pthread_barrier_t barrier;
+    pthread_barrier_init(&barrier, NULL, REFCOUNT_THREADS);
+    struct refcount_release_args args = {p2, &barrier};
+    for (int i = 0; i < REFCOUNT_THREADS; i++) {
+      ASSERT_EQ(0, pthread_create(&threads[i], NULL, refcount_release, &args));
+    }
+    for (int i = 0; i < REFCOUNT_THREADS; i++) {
+      ASSERT_EQ(0, pthread_join(threads[i], NULL));
+    }
+    pthread_barrier_destroy(&barrier);
+
+    ASSERT_EQ(p2, static_alloc_alloc(10));
+    // Class is exhausted again: regular allocation
+    void* p3 = static_alloc_alloc(10);
+    ASSERT_NE(p2, p3);
+    static_alloc_free(p3);
+    static_alloc_free(p2);
+  }
+  ASSERT_EQ(mem_free, static_alloc_info_mem_free());
+}
+
+static void* isr_hammer(void* arg)
+{
+  uint32_t* failed = (uint32_t*)arg;
+
+  for (int i = 0; i < 100000; i++) {
+    void* p = static_alloc_alloc_isr(16);
+    if (p == NULL) {
+      (*failed)++;
+      continue;
+    }
+    memset(p, 0xAA, 16);
+    static_alloc_free(p);
+  }
+  return NULL;
+}
+
+TEST(static_alloc, alloc_isr) {
+  uint8_t buf[2048];
+  static_alloc_init(buf, sizeof(buf));
+  // Not class size: no memory for interrupts
+  ASSERT_EQ(NULL, static_alloc_alloc_isr(10));
+
+  struct static_alloc_class classes[] = {
+    {32, 1},
+  };
+  ASSERT_TRUE(static_alloc_init_classes(classes, 1));
+  uint32_t mem_free = static_alloc_info_mem_free();
+
+  void* p1 = static_alloc_alloc_isr(1);
+  ASSERT_TRUE(p1);
+  // Class exhausted / too large: never falls back to block allocator
+  ASSERT_EQ(NULL, static_alloc_alloc_isr(10));
+  ASSERT_EQ(NULL, static_alloc_alloc_isr(33));
+  ASSERT_EQ(mem_free, static_alloc_info_mem_free());
+  static_alloc_free(p1);
+  ASSERT_EQ(1U, classes[0].hits);
+  ASSERT_EQ(1U, classes[0].misses);
+
+  // "Interrupt" allocates / frees class items while task does the same,
+  // its misses are served by block allocator
+  uint32_t isr_failed = 0;
+  pthread_t isr;
+  ASSERT_EQ(0, pthread_create(&isr, NULL, isr_hammer, &isr_failed));
+  for (int i = 0; i < 100000; i++) {
+    void* p = static_alloc_alloc(20);
+    ASSERT_TRUE(p);
+    memset(p, 0x55, 20);
+    static_alloc_free(p);
+  }
+  ASSERT_EQ(0, pthread_join(isr, NULL));
+
+  // Item is back in free list, blocks taken on misses are released
+  ASSERT_EQ(mem_free, static_alloc_info_mem_free());
+  ASSERT_EQ(200002U, classes[0].hits + classes[0].misses);
+  ASSERT_LE(isr_failed, classes[0].misses);
+  p1 = static_alloc_alloc_isr(32);
+  ASSERT_TRUE(p1);
+  ASSERT_EQ(NULL, static_alloc_alloc_isr(32));
+  static_alloc_free(p1);
+}
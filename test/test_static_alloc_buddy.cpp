@@ -0,0 +1,172 @@
+// Copyright (c) Konstantin Belyalov. All rights reserved.
+// Licensed under the MIT license.
+//
+// Tests of buddy backend: static_alloc.c compiled with STATIC_ALLOC_BUDDY
+// (separate test binary).
+
+#include <gtest/gtest.h>
+#include <string.h>
+#include "static_alloc.h"
+
+using namespace std;
+
+static uint32_t largest_free()
+{
+  struct static_alloc_stats stats;
+
+  static_alloc_stats(&stats);
+  return stats.largest_free;
+}
+
+TEST(static_alloc_buddy, sanity) {
+  // 1 metadata block + 16 blocks: single chunk of order 4
+  uint8_t buf[64 * 17];
+  static_alloc_init(buf, sizeof(buf));
+  ASSERT_EQ(16 * 64, static_alloc_info_mem_free());
+  ASSERT_EQ(16 * 64, largest_free());
+
+  // 1 block: 16 -> 8 + 4 + 2 + 1 + 1
+  void* p1 = static_alloc_alloc(1);
+  ASSERT_TRUE(p1);
+  ASSERT_EQ(buf + 64, (uint8_t*)p1 - 4);
+  ASSERT_EQ(15 * 64, static_alloc_info_mem_free());
+  ASSERT_EQ(8 * 64, largest_free());
+
+  // 3 blocks are rounded up to 4
+  void* p2 = static_alloc_alloc(150);
+  ASSERT_TRUE(p2);
+  ASSERT_EQ(buf + 64 + 4 * 64, (uint8_t*)p2 - 4);
+  ASSERT_EQ(11 * 64, static_alloc_info_mem_free());
+
+  // Too big: 8 blocks is the largest chunk
+  ASSERT_FALSE(static_alloc_alloc(8 * 64));
+  void* p3 = static_alloc_alloc(8 * 64 - 4);
+  ASSERT_TRUE(p3);
+  ASSERT_EQ(3 * 64, static_alloc_info_mem_free());
+
+  // Free coalesces buddies back into the single chunk
+  static_alloc_free(p1);
+  ASSERT_EQ(4 * 64, largest_free());
+  static_alloc_free(p3);
+  ASSERT_EQ(8 * 64, largest_free());
+  static_alloc_free(p2);
+  ASSERT_EQ(16 * 64, static_alloc_info_mem_free());
+  ASSERT_EQ(16 * 64, largest_free());
+}
+
+TEST(static_alloc_buddy, not_power_of_two) {
+  // 13 blocks: 8 + 4 + 1
+  uint8_t buf[64 * 14];
+  static_alloc_init(buf, sizeof(buf));
+  ASSERT_EQ(13 * 64, static_alloc_info_mem_free());
+  ASSERT_EQ(8 * 64, largest_free());
+
+  void* p1 = static_alloc_alloc(1);
+  void* p2 = static_alloc_alloc(200);
+  void* p3 = static_alloc_alloc(500);
+  ASSERT_TRUE(p1);
+  ASSERT_TRUE(p2);
+  ASSERT_TRUE(p3);
+  ASSERT_EQ(0, static_alloc_info_mem_free());
+  ASSERT_FALSE(static_alloc_alloc(1));
+
+  // Top level chunks never merge
+  static_alloc_free(p1);
+  static_alloc_free(p2);
+  static_alloc_free(p3);
+  ASSERT_EQ(13 * 64, static_alloc_info_mem_free());
+  ASSERT_EQ(8 * 64, largest_free());
+}
+
+TEST(static_alloc_buddy, random) {
+  uint8_t buf[64 * 129];
+  void* items[64] = {};
+  uint32_t sizes[64] = {};
+  static_alloc_init(buf, sizeof(buf));
+
+  srand(1);
+  for (int i = 0; i < 20000; i++) {
+    int n = rand() % 64;
+    if (items[n]) {
+      // Content is intact
+      for (uint32_t b = 0; b < sizes[n]; b++) {
+        ASSERT_EQ((uint8_t)n, ((uint8_t*)items[n])[b]);
+      }
+      static_alloc_free(items[n]);
+      items[n] = NULL;
+    } else {
+      sizes[n] = rand() % 600 + 1;
+      items[n] = static_alloc_alloc(sizes[n]);
+      if (items[n]) {
+        memset(items[n], n, sizes[n]);
+      }
+    }
+  }
+  for (int n = 0; n < 64; n++) {
+    if (items[n]) {
+      static_alloc_free(items[n]);
+    }
+  }
+  // Everything coalesced back
+  ASSERT_EQ(128 * 64, static_alloc_info_mem_free());
+  ASSERT_EQ(128 * 64, largest_free());
+}
+
+TEST(static_alloc_buddy, realloc) {
+  uint8_t buf[64 * 9];
+  static_alloc_init(buf, sizeof(buf));
+
+  uint8_t* p1 = (uint8_t*)static_alloc_alloc(10);
+  memset(p1, 0x11, 10);
+  // Grow in place: free buddies are taken
+  ASSERT_EQ(p1, static_alloc_realloc(p1, 200));
+  ASSERT_EQ(4 * 64, static_alloc_info_mem_free());
+  // Shrink: upper halves are released
+  ASSERT_EQ(p1, static_alloc_realloc(p1, 60));
+  ASSERT_EQ(7 * 64, static_alloc_info_mem_free());
+  ASSERT_EQ(4 * 64, largest_free());
+
+  // Upper half of 2 blocks chunk can't grow in place: moved
+  void* p2 = static_alloc_alloc(1);
+  uint8_t* p3 = (uint8_t*)static_alloc_realloc(p2, 100);
+  ASSERT_TRUE(p3);
+  ASSERT_NE(p2, p3);
+  // Lower one takes released buddy
+  ASSERT_EQ(p1, static_alloc_realloc(p1, 100));
+  // ... but then it is blocked by allocated one
+  memset(p1, 0x22, 100);
+  uint8_t* p4 = (uint8_t*)static_alloc_realloc(p1, 200);
+  ASSERT_TRUE(p4);
+  ASSERT_NE(p1, p4);
+  for (int i = 0; i < 100; i++) {
+    ASSERT_EQ(0x22, p4[i]);
+  }
+
+  static_alloc_free(p3);
+  static_alloc_free(p4);
+  ASSERT_EQ(8 * 64, static_alloc_info_mem_free());
+  ASSERT_EQ(8 * 64, largest_free());
+}
+
+TEST(static_alloc_buddy, size_classes) {
+  uint8_t buf[64 * 17];
+  struct static_alloc_class classes[] = {
+    {16, 4},
+    {100, 2},
+  };
+  static_alloc_init(buf, sizeof(buf));
+  ASSERT_TRUE(static_alloc_init_classes(classes, 2));
+  // Class items take power of two blocks as well: 4 * 1 + 2 * 2
+  ASSERT_EQ(8 * 64, static_alloc_info_mem_free());
+
+  void* p1 = static_alloc_alloc(10);
+  void* p2 = static_alloc_alloc(90);
+  ASSERT_TRUE(p1);
+  ASSERT_TRUE(p2);
+  ASSERT_EQ(1U, classes[0].hits);
+  ASSERT_EQ(1U, classes[1].hits);
+  ASSERT_EQ(8 * 64, static_alloc_info_mem_free());
+  static_alloc_free(p1);
+  static_alloc_free(p2);
+  ASSERT_EQ(8 * 64, static_alloc_info_mem_free());
+}
@@ -0,0 +1,123 @@
+// Copyright (c) Konstantin Belyalov. All rights reserved.
+// Licensed under the MIT license.
+
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+
+#include "static_alloc.hpp"
+
+using namespace std;
+
+struct counted {
+  static int alive;
+  uint32_t value;
+
+  explicit counted(uint32_t v) : value(v) { alive++; }
+  ~counted() { alive--; }
+};
+
+int counted::alive = 0;
+
+TEST(static_alloc_cpp, shared_ptr) {
+  uint8_t buf[1024];
+  static_alloc_init(buf, sizeof(buf));
+  uint32_t mem_free = static_alloc_info_mem_free();
+
+  {
+    static_shared_ptr<counted> p1 = make_static_shared<counted>(10);
+    ASSERT_TRUE(p1);
+    ASSERT_EQ(10U, p1->value);
+    ASSERT_EQ(1, counted::alive);
+    ASSERT_EQ(mem_free - 64, static_alloc_info_mem_free());
+
+    // Copies share the same object
+    static_shared_ptr<counted> p2 = p1;
+    static_shared_ptr<counted> p3;
+    p3 = p2;
+    ASSERT_EQ(p1, p3);
+    p2.reset();
+    ASSERT_FALSE(p2);
+    p1.reset();
+    // Still owned by p3
+    ASSERT_EQ(1, counted::alive);
+    ASSERT_EQ(10U, (*p3).value);
+
+    // Move: ownership transferred
+    static_shared_ptr<counted> p4(std::move(p3));
+    ASSERT_FALSE(p3);
+    ASSERT_EQ(10U, p4->value);
+    p1 = std::move(p4);
+    ASSERT_FALSE(p4);
+    ASSERT_EQ(1, counted::alive);
+  }
+  // The last owner destroyed object and released memory
+  ASSERT_EQ(0, counted::alive);
+  ASSERT_EQ(mem_free, static_alloc_info_mem_free());
+
+  // Assignment releases previous object
+  static_shared_ptr<counted> p1 = make_static_shared<counted>(1);
+  p1 = make_static_shared<counted>(2);
+  ASSERT_EQ(2U, p1->value);
+  ASSERT_EQ(1, counted::alive);
+  p1 = nullptr;
+  ASSERT_EQ(0, counted::alive);
+  ASSERT_EQ(mem_free, static_alloc_info_mem_free());
+}
+
+TEST(static_alloc_cpp, shared_ptr_no_memory) {
+  uint8_t buf[128];
+  static_alloc_init(buf, sizeof(buf));
+
+  static_shared_ptr<uint32_t> p1 = make_static_shared<uint32_t>(1);
+  ASSERT_TRUE(p1);
+  // Out of memory: empty pointer
+  static_shared_ptr<uint32_t> p2 = make_static_shared<uint32_t>(2);
+  ASSERT_FALSE(p2);
+  p1.reset();
+  ASSERT_EQ(64U, static_alloc_info_mem_free());
+}
+
+TEST(static_alloc_cpp, unref) {
+  uint8_t buf[256];
+  static_alloc_init(buf, sizeof(buf));
+
+  void* p = static_alloc_alloc(10);
+  static_alloc_copy(p);
+  ASSERT_FALSE(static_alloc_unref(p));
+  // The last reference is kept
+  ASSERT_TRUE(static_alloc_unref(p));
+  ASSERT_TRUE(static_alloc_unref(p));
+  ASSERT_EQ(128U, static_alloc_info_mem_free());
+  static_alloc_free(p);
+  ASSERT_EQ(192U, static_alloc_info_mem_free());
+}
+
+TEST(static_alloc_cpp, allocator) {
+  uint8_t buf[4096];
+  static_alloc_init(buf, sizeof(buf));
+  uint32_t mem_free = static_alloc_info_mem_free();
+
+  {
+    vector<uint32_t, static_allocator<uint32_t>> v;
+    v.reserve(100);
+    for (uint32_t i = 0; i < 100; i++) {
+      v.push_back(i);
+    }
+    ASSERT_EQ(mem_free - 7 * 64, static_alloc_info_mem_free());
+    ASSERT_EQ(99U, v[99]);
+
+    typedef basic_string<char, char_traits<char>, static_allocator<char>> static_string;
+    static_string s("static allocator string, long enough to not fit into small string buffer");
+    s += "!";
+    ASSERT_EQ('!', s.back());
+  }
+  ASSERT_EQ(mem_free, static_alloc_info_mem_free());
+
+#if defined(__cpp_exceptions) || defined(__EXCEPTIONS)
+  vector<uint32_t, static_allocator<uint32_t>> v;
+  ASSERT_THROW(v.reserve(10000), std::bad_alloc);
+#endif
+
+  ASSERT_TRUE(static_allocator<uint32_t>() == static_allocator<char>());
+}
@@ -0,0 +1,67 @@
+// Copyright (c) Konstantin Belyalov. All rights reserved.
+// Licensed under the MIT license.
+
+#include <gtest/gtest.h>
+#include <vector>
+
+#include "static_alloc_nanopb.h"
+
+using namespace std;
+
+TEST(static_alloc_nanopb, encode)
+{
+  struct static_alloc_stats stats;
+  memset(&stats, 0, sizeof(stats));
+  stats.allocs = 3;
+  stats.bytes_used = 128;
+  stats.sizes[0] = 3;
+  stats.failed_sizes[STATIC_ALLOC_STATS_BUCKETS - 1] = 1;
+
+  // Zero scalars are skipped, histograms are always encoded in full
+  vector<uint8_t> expected = {0x08, 0x03, 0x18, 0x80, 0x01};
+  expected.push_back(0x32);
+  expected.push_back(STATIC_ALLOC_STATS_BUCKETS);
+  expected.push_back(3);
+  expected.insert(expected.end(), STATIC_ALLOC_STATS_BUCKETS - 1, 0);
+  expected.push_back(0x3A);
+  expected.push_back(STATIC_ALLOC_STATS_BUCKETS);
+  expected.insert(expected.end(), STATIC_ALLOC_STATS_BUCKETS - 1, 0);
+  expected.push_back(1);
+
+  uint8_t buf[128];
+  pb_ostream_t stream = pb_ostream_from_buffer(buf, sizeof(buf));
+  ASSERT_TRUE(pb_encode_static_alloc_stats(&stream, &stats));
+  ASSERT_EQ(expected, vector<uint8_t>(buf, buf + stream.bytes_written));
+
+  // Length prefixed
+  stream = pb_ostream_from_buffer(buf, sizeof(buf));
+  ASSERT_TRUE(pb_encode_static_alloc_stats_delimited(&stream, &stats));
+  ASSERT_EQ(expected.size() + 1, stream.bytes_written);
+  ASSERT_EQ(expected.size(), buf[0]);
+  ASSERT_EQ(expected, vector<uint8_t>(buf + 1, buf + stream.bytes_written));
+
+  // Does not fit
+  stream = pb_ostream_from_buffer(buf, 10);
+  ASSERT_FALSE(pb_encode_static_alloc_stats(&stream, &stats));
+}
+
+TEST(static_alloc_nanopb, snapshot)
+{
+  uint8_t pool[1024];
+  struct static_alloc_stats stats;
+  static_alloc_init(pool, sizeof(pool));
+  void* p = static_alloc_alloc(100);
+  static_alloc_stats(&stats);
+  static_alloc_free(p);
+
+  uint8_t buf[128];
+  pb_ostream_t stream = pb_ostream_from_buffer(buf, sizeof(buf));
+  ASSERT_TRUE(pb_encode_static_alloc_stats(&stream, &stats));
+  // allocs: 1
+  ASSERT_EQ(0x08, buf[0]);
+  ASSERT_EQ(1, buf[1]);
+  // bytes_used: 128
+  ASSERT_EQ(0x18, buf[2]);
+  ASSERT_EQ(0x80, buf[3]);
+  ASSERT_EQ(0x01, buf[4]);
+}